@@ -58,28 +58,30 @@ vector<string> split(const string &s, char delimiter)
  * Kept includes indexes of kept files, and its indexing starts at 1 because of 
  * UI reasons.
  */
-void remove_files(const vector<size_t> &kept, const DuplicateVector &files)
+void remove_files(const vector<size_t> &kept, const DuplicateVector &files,
+                  const FileCatalog &catalog)
 {
     for (size_t i = 1; i <= files.size(); ++i)
     {
+        const string path = catalog.path(files[i-1]);
         if (std::find(kept.begin(), kept.end(), i) == kept.end())
         {
             try
             {
-                if (fs::last_write_time(files[i-1].path) > files[i-1].m_time)
+                if (fs::last_write_time(path) > catalog.m_time(files[i-1]))
                 {
-                    cerr << "File \"" << files[i-1].path << "\" has been "
+                    cerr << "File \"" << path << "\" has been "
                     "modified after it was scanned. Did not delete it.\n";
                 }
                 else
                 {
-                    if (fs::remove(files[i-1].path))
+                    if (fs::remove(path))
                     {
-                        cout << "Deleted file \"" << files[i-1].path << "\"\n";
+                        cout << "Deleted file \"" << path << "\"\n";
                     }
                     else
                     {
-                        cerr << "File \"" << files[i-1].path
+                        cerr << "File \"" << path
                              << "\" not found, could not delete it\n\n";
                     }
                 }                
@@ -91,7 +93,7 @@ void remove_files(const vector<size_t> &kept, const DuplicateVector &files)
         }
         else
         {
-            cout << "Kept file \"" << files[i-1].path << "\"\n";
+            cout << "Kept file \"" << path << "\"\n";
         }
     }
     cout << '\n';
@@ -101,15 +103,16 @@ void remove_files(const vector<size_t> &kept, const DuplicateVector &files)
  * Asks the user to select on the command line which files are kept 
  * in each set of duplicates.
  */
-void prompt_duplicate_deletions(const vector<DuplicateVector> &duplicates)
+void prompt_duplicate_deletions(const Duplicates &duplicates)
 {
     // For each set of duplicates
-    for (const auto &dup_vec : duplicates)
+    for (const auto &dup_vec : duplicates.sets)
     {
         // Print the paths of the set of duplicates
         for (size_t i = 1; i <= dup_vec.size(); ++i)
         {
-            cout << "[" << i << "] " << dup_vec[i-1].path << '\n';
+            cout << "[" << i << "] " 
+                 << duplicates.files.path(dup_vec[i-1]) << '\n';
         }
         cout << endl;
 
@@ -127,7 +130,7 @@ void prompt_duplicate_deletions(const vector<DuplicateVector> &duplicates)
             {
                 valid_input = true;
                 vector<size_t> empty;
-                remove_files(empty, dup_vec);
+                remove_files(empty, dup_vec, duplicates.files);
             }
             else if (input == "a" || input == "all") // Keep all
             {
@@ -154,7 +157,7 @@ void prompt_duplicate_deletions(const vector<DuplicateVector> &duplicates)
 
                 if (valid_input)
                 {
-                    remove_files(kept, dup_vec);
+                    remove_files(kept, dup_vec, duplicates.files);
                 }
             }
         }        
@@ -166,12 +169,13 @@ void prompt_duplicate_deletions(const vector<DuplicateVector> &duplicates)
  * links to the one kept. Use hard link or symlink based on argument. Done in 
  * three stages in order to enable error recovery.
  */
-void link_files(const DuplicateVector &files, bool hard_link)
+void link_files(const DuplicateVector &files, bool hard_link,
+                const FileCatalog &catalog)
 {
+    const fs::path target = catalog.path(files[0]);
     for (size_t i = 2; i <= files.size(); ++i)
     {
-        fs::path target = files[0].path;
-        fs::path link = files[i-1].path;
+        fs::path link = catalog.path(files[i-1]);
 
         fs::path temp_path = 
             (fs::path(link)
@@ -180,13 +184,13 @@ void link_files(const DuplicateVector &files, bool hard_link)
         
         try
         {
-            if (fs::last_write_time(target) > files[0].m_time)
+            if (fs::last_write_time(target) > catalog.m_time(files[0]))
             {
                 cerr << "The link target " << target << " has been "
                 "modified after it was scanned. Aborting the linking process.";
                 return;
             }
-            else if (fs::last_write_time(link) > files[i-1].m_time)
+            else if (fs::last_write_time(link) > catalog.m_time(files[i-1]))
             {
                 cerr << "File " << link << " has been "
                 "modified after it was scanned. Did not "
@@ -262,9 +266,9 @@ void link_files(const DuplicateVector &files, bool hard_link)
 /**
  * Deal with the given duplicates using the given action.
  */
-void deal_with_duplicates(Action action, vector<DuplicateVector> duplicates)
+void deal_with_duplicates(Action action, Duplicates duplicates)
 {
-    if (duplicates.empty())
+    if (duplicates.sets.empty())
     {
         cout << "Didn't find any duplicates." << endl;
         return;
@@ -272,27 +276,34 @@ void deal_with_duplicates(Action action, vector<DuplicateVector> duplicates)
 
     size_t number_of_duplicate_files = 0;
     uintmax_t duplicates_size = 0;
-    for (auto &dup_vec : duplicates)
+    for (auto &dup_vec : duplicates.sets)
     {
         // A set of n identical files has n - 1 duplicate files
         number_of_duplicate_files += dup_vec.size() - 1;
         duplicates_size += (dup_vec.size() - 1) 
-                        * fs::file_size(dup_vec[0].path);
+                        * duplicates.files.size(dup_vec[0]);
         
         // Sort the files in duplicate vectors, first by the order in which
         // their (parent) paths were given on the command line, then by their
         // last modification time. Both are earliest first. This determines
-        // which file is kept in non-prompting actions.
+        // which file is kept in non-prompting actions. Files are found in no
+        // particular order, so ties in modification time are broken by the 
+        // inode number, which usually grows in the order of creation.
+        const FileCatalog &files = duplicates.files;
         std::sort(dup_vec.begin(), dup_vec.end(), 
-            [](const File &f1, const File &f2) 
+            [&files](FileId f1, FileId f2) 
             {
-                if (f1.number_of_path == f2.number_of_path)
+                if (files.number_of_path(f1) != files.number_of_path(f2))
                 {
-                    return f1.m_time < f2.m_time;
+                    return files.number_of_path(f1) < files.number_of_path(f2);
+                }
+                else if (files.m_time(f1) != files.m_time(f2))
+                {
+                    return files.m_time(f1) < files.m_time(f2);
                 }
                 else
                 {
-                    return f1.number_of_path < f2.number_of_path;
+                    return files.inode(f1) < files.inode(f2);
                 }
                 
             }
@@ -301,19 +312,19 @@ void deal_with_duplicates(Action action, vector<DuplicateVector> duplicates)
 
     cout << "Found " << number_of_duplicate_files
          << " duplicate file" << (number_of_duplicate_files > 1 ? "s" : "") 
-         << " in " << duplicates.size() 
-         << " set" << (duplicates.size() > 1 ? "s" : "") << ".\n"
+         << " in " << duplicates.sets.size() 
+         << " set" << (duplicates.sets.size() > 1 ? "s" : "") << ".\n"
          << format_bytes(duplicates_size) << " could be freed." << endl;     
 
     switch (action)
     {
     case Action::list:
         cout << '\n';
-        for (const auto &dup_vec : duplicates)
+        for (const auto &dup_vec : duplicates.sets)
         {
             for (const auto &file : dup_vec)
             {
-                cout << file.path << '\n';
+                cout << duplicates.files.path(file) << '\n';
             }
             cout << endl;
         }
@@ -321,10 +332,10 @@ void deal_with_duplicates(Action action, vector<DuplicateVector> duplicates)
 
     case Action::no_prompt_delete:
         cout << '\n';
-        for (const auto &dup_vec : duplicates)
+        for (const auto &dup_vec : duplicates.sets)
         {
             vector<size_t> keep_only_first{1};
-            remove_files(keep_only_first, dup_vec);
+            remove_files(keep_only_first, dup_vec, duplicates.files);
         }
         break;
 
@@ -335,17 +346,17 @@ void deal_with_duplicates(Action action, vector<DuplicateVector> duplicates)
 
     case Action::hardlink:
         cout << '\n';
-        for (const auto &dup_vec : duplicates)
+        for (const auto &dup_vec : duplicates.sets)
         {
-            link_files(dup_vec, true);
+            link_files(dup_vec, true, duplicates.files);
         }
         break;
 
     case Action::symlink:
         cout << '\n';
-        for (const auto &dup_vec : duplicates)
+        for (const auto &dup_vec : duplicates.sets)
         {
-            link_files(dup_vec, false);
+            link_files(dup_vec, false, duplicates.files);
         }
         break;
 
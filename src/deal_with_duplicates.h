@@ -8,7 +8,6 @@
 /**
  * Deal with the given duplicates using the given action.
  */
-void deal_with_duplicates(Action action, 
-    std::vector<DuplicateVector> duplicates);
+void deal_with_duplicates(Action action, Duplicates duplicates);
 
 #endif // DEAL_WITH_DUPLICATES_H
@@ -0,0 +1,225 @@
+#ifndef EXTERNAL_SORT_H
+#define EXTERNAL_SORT_H
+
+#include "scratch_file.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * How a record is written to a run and read back. By default the bytes of
+ * the record are copied, which only records without padding allow, so that
+ * no indeterminate bytes go to the files. Records with padding specialize
+ * the format to copy their fields one by one into size bytes.
+ */
+template <typename Record>
+struct RunFormat {
+    static_assert(std::has_unique_object_representations_v<Record>,
+                  "Records with padding need a RunFormat of their own");
+
+    static constexpr std::size_t size = sizeof(Record);
+
+    static void write(const Record &record, unsigned char *data)
+    {
+        std::memcpy(data, &record, size);
+    }
+
+    static void read(const unsigned char *data, Record &record)
+    {
+        std::memcpy(&record, data, size);
+    }
+};
+
+/**
+ * Sorts records that may not fit in memory. The records are collected in a
+ * buffer that takes at most the given number of bytes. When it is full, it
+ * is sorted and written to a ScratchFile as a run, and in the end the runs
+ * are combined with a k-way merge. If all the records fit in the buffer,
+ * nothing is written. Records are ordered by operator<, and written to the
+ * runs in their RunFormat.
+ *
+ * Each run keeps a file open, so runs are merged in levels: whenever there
+ * are max_fan_in runs of the same level, they are merged into one run of the
+ * next level. Each record is then written once per level, and the number of
+ * open files grows only with the number of levels.
+ */
+template <typename Record>
+class ExternalSorter {
+        struct Run {
+            std::unique_ptr<ScratchFile> file;
+            unsigned level;
+        };
+        using Runs = std::vector<Run>;
+        using Format = RunFormat<Record>;
+
+        static constexpr std::size_t max_fan_in = 64;
+
+        std::vector<Record> buffer;
+        const std::size_t capacity;
+        Runs runs;
+        std::size_t run_total;
+
+        /**
+         * Calls the given function with the records of the given runs in
+         * order. Records that are equal come in the order of their runs.
+         */
+        template <typename Function>
+        static void merge_runs(typename Runs::iterator first,
+                               typename Runs::iterator last,
+                               Function function)
+        {
+            struct Head {
+                Record record;
+                std::size_t run;
+            };
+            const auto later = [](const Head &a, const Head &b)
+            {
+                return b.record < a.record
+                    || (!(a.record < b.record) && b.run < a.run);
+            };
+            const auto read = [first](Head &head)
+            {
+                unsigned char data[Format::size];
+                if (first[head.run].file->read(data, Format::size)
+                    != Format::size)
+                {
+                    return false;
+                }
+                Format::read(data, head.record);
+                return true;
+            };
+
+            std::vector<Head> heap;
+            for (auto run = first; run != last; ++run)
+            {
+                run->file->rewind();
+                Head head{Record(), static_cast<std::size_t>(run - first)};
+                if (read(head))
+                {
+                    heap.push_back(head);
+                }
+            }
+            std::make_heap(heap.begin(), heap.end(), later);
+            while (!heap.empty())
+            {
+                std::pop_heap(heap.begin(), heap.end(), later);
+                Head &head = heap.back();
+                function(head.record);
+                if (read(head))
+                {
+                    std::push_heap(heap.begin(), heap.end(), later);
+                }
+                else
+                {
+                    heap.pop_back();
+                }
+            }
+        }
+
+        static void write(ScratchFile &file, const Record &record)
+        {
+            unsigned char data[Format::size];
+            Format::write(record, data);
+            file.write(data, Format::size);
+        }
+
+        /**
+         * Merges the given number of last runs into one run of the next
+         * level.
+         */
+        void merge_last_runs(std::size_t count)
+        {
+            const auto first = runs.end() - static_cast<std::ptrdiff_t>(count);
+            Run merged{std::make_unique<ScratchFile>(), first->level + 1};
+            merge_runs(first, runs.end(),
+                       [&merged](const Record &record)
+                       {
+                           write(*merged.file, record);
+                       });
+            runs.erase(first, runs.end());
+            runs.push_back(std::move(merged));
+        }
+
+        void spill()
+        {
+            std::sort(buffer.begin(), buffer.end());
+            Run run{std::make_unique<ScratchFile>(), 0};
+            for (const auto &record : buffer)
+            {
+                write(*run.file, record);
+            }
+            runs.push_back(std::move(run));
+            ++run_total;
+            buffer.clear();
+            // Levels only decrease towards the end
+            while (runs.size() >= max_fan_in
+                   && runs[runs.size() - max_fan_in].level
+                      == runs.back().level)
+            {
+                merge_last_runs(max_fan_in);
+            }
+        }
+
+    public:
+        explicit ExternalSorter(std::size_t memory_limit)
+            : capacity(std::max<std::size_t>(1,
+                                             memory_limit / sizeof(Record))),
+              run_total(0)
+        {
+        }
+
+        void add(const Record &record)
+        {
+            if (buffer.size() == capacity)
+            {
+                spill();
+            }
+            if (buffer.size() == buffer.capacity())
+            {
+                // Grows like a vector, but not beyond the limit
+                buffer.reserve(std::min(capacity,
+                    std::max<std::size_t>(16, 2 * buffer.size())));
+            }
+            buffer.push_back(record);
+        }
+
+        /**
+         * Returns the number of sorted runs that have been written so far,
+         * not counting the runs that merging them produced.
+         */
+        std::size_t run_count() const {return run_total;}
+
+        /**
+         * Calls the given function with every added record in order, and
+         * forgets the records.
+         */
+        template <typename Function>
+        void merge(Function function)
+        {
+            if (runs.empty())
+            {
+                std::sort(buffer.begin(), buffer.end());
+                for (const auto &record : buffer)
+                {
+                    function(record);
+                }
+                std::vector<Record>().swap(buffer);
+                return;
+            }
+
+            if (!buffer.empty())
+            {
+                spill();
+            }
+            std::vector<Record>().swap(buffer);
+            merge_runs(runs.begin(), runs.end(), function);
+            runs.clear();
+        }
+};
+
+#endif // EXTERNAL_SORT_H
@@ -0,0 +1,27 @@
+#include "file_catalog.h"
+
+#include <limits>
+#include <stdexcept>
+
+FileId FileCatalog::add(const ScannedFile &file)
+{
+    if (count() == std::numeric_limits<FileId>::max())
+    {
+        throw std::length_error("Too many files");
+    }
+    dirs.push_back(file.path.dir);
+    names.push_back(file.path.name);
+    sizes.push_back(file.size);
+    m_times.push_back(file.m_time);
+    devices.push_back(file.device);
+    inodes.push_back(file.inode);
+    roots.push_back(static_cast<uint32_t>(file.number_of_path));
+    return static_cast<FileId>(count() - 1);
+}
+
+void FileCatalog::relink(FileId id, PathHandle path, std::size_t number_of_path)
+{
+    dirs[id] = path.dir;
+    names[id] = path.name;
+    roots[id] = static_cast<uint32_t>(number_of_path);
+}
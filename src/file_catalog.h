@@ -0,0 +1,120 @@
+#ifndef FILE_CATALOG_H
+#define FILE_CATALOG_H
+
+#include "path_store.h"
+#include "traverse.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+/**
+ * Identifies a file in a FileCatalog.
+ */
+using FileId = uint32_t;
+
+/**
+ * An array that grows in chunks of fixed size. Unlike a vector, it is never
+ * copied when it grows, and it never has more than one chunk of unused
+ * capacity.
+ */
+template <typename T>
+class Column {
+        static constexpr std::size_t chunk_bits = 16;
+        static constexpr std::size_t chunk_size = std::size_t(1) << chunk_bits;
+
+        std::vector<std::vector<T>> chunks;
+
+    public:
+        void push_back(const T &value)
+        {
+            if (chunks.empty() || chunks.back().size() == chunk_size)
+            {
+                chunks.emplace_back();
+                chunks.back().reserve(chunk_size);
+            }
+            chunks.back().push_back(value);
+        }
+
+        std::size_t size() const
+        {
+            return chunks.empty()
+                ? 0 : (chunks.size() - 1) * chunk_size + chunks.back().size();
+        }
+
+        T &operator[](std::size_t i)
+        {
+            return chunks[i >> chunk_bits][i & (chunk_size - 1)];
+        }
+
+        const T &operator[](std::size_t i) const
+        {
+            return chunks[i >> chunk_bits][i & (chunk_size - 1)];
+        }
+};
+
+/**
+ * Stores the metadata of the scanned files. Each attribute is stored in its
+ * own column, indexed by FileId, so the deduplication tables only need to hold
+ * the ids. The paths of the files are stored in a PathStore.
+ *
+ * When a file is asked to be deleted, its modification time is used to check
+ * if the file has been modified after it has been scanned. The inode number
+ * breaks ties between files that have the same modification time.
+ */
+class FileCatalog {
+        PathStore store;
+        Column<DirId> dirs;
+        Column<uint64_t> names;
+        Column<uintmax_t> sizes;
+        Column<std::filesystem::file_time_type> m_times;
+        Column<uintmax_t> devices;
+        Column<uintmax_t> inodes;
+        // Index of the given path that the file was found in
+        Column<uint32_t> roots;
+
+    public:
+        /**
+         * Adds the given file and returns its id.
+         */
+        FileId add(const ScannedFile &file);
+
+        /**
+         * Replaces the path of the given file with another link to it.
+         */
+        void relink(FileId id, PathHandle path, std::size_t number_of_path);
+
+        std::size_t count() const {return roots.size();}
+
+        PathStore &paths() {return store;}
+        const PathStore &paths() const {return store;}
+
+        uintmax_t size(FileId id) const {return sizes[id];}
+        std::filesystem::file_time_type m_time(FileId id) const
+        {
+            return m_times[id];
+        }
+        uintmax_t device(FileId id) const {return devices[id];}
+        uintmax_t inode(FileId id) const {return inodes[id];}
+        std::size_t number_of_path(FileId id) const {return roots[id];}
+        PathHandle handle(FileId id) const {return PathHandle{dirs[id],
+                                                              names[id]};}
+
+        /**
+         * Returns the full path of the given file.
+         */
+        std::string path(FileId id) const {return store.path(handle(id));}
+
+        /**
+         * Puts the full path of the given file in the given string, reusing
+         * its memory, and returns the string.
+         */
+        const std::string &path(FileId id, std::string &out) const
+        {
+            store.path(handle(id), out);
+            return out;
+        }
+};
+
+#endif // FILE_CATALOG_H
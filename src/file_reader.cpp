@@ -0,0 +1,282 @@
+#include "file_reader.h"
+#include "hash_kernel.h"
+#include "input_file.h"
+#include "memory_compare.h"
+#include "utilities.h"
+
+#include <algorithm>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+using std::size_t;
+using std::string;
+
+namespace {
+// Buffers are aligned to pages, so that the kernel can copy whole pages
+constexpr std::align_val_t alignment{4096};
+
+#ifdef __linux__
+/**
+ * A read-only memory map of a part of a file.
+ */
+class MappedWindow {
+        void *data;
+        size_t length;
+
+    public:
+        MappedWindow(InputFile &file, size_t l) : length(l)
+        {
+            data = mmap(nullptr, length, PROT_READ, MAP_SHARED,
+                        file.descriptor(), 
+                        static_cast<off_t>(file.position()));
+            if (data != MAP_FAILED)
+            {
+                madvise(data, length, MADV_SEQUENTIAL);
+            }
+        }
+
+        ~MappedWindow()
+        {
+            if (data != MAP_FAILED)
+            {
+                munmap(data, length);
+            }
+        }
+
+        MappedWindow(const MappedWindow &) = delete;
+        MappedWindow &operator=(const MappedWindow &) = delete;
+
+        bool valid() const {return data != MAP_FAILED;}
+        const char *bytes() const {return static_cast<const char*>(data);}
+};
+
+// The first window is small, so that little is read from files that differ
+// early. Windows grow as long as the files match.
+constexpr size_t first_window = 1 << 20;
+constexpr size_t last_window = 64 << 20;
+
+enum class MapResult {equal, different, unmappable};
+
+/**
+ * Compares the files of the given size through memory maps, from their
+ * current positions to their ends. If a part of the files can't be mapped,
+ * the positions are left at the beginning of that part.
+ */
+MapResult compare_mapped(InputFile &file1, InputFile &file2, uintmax_t size)
+{
+    size_t window = first_window;
+    while (file1.position() < size)
+    {
+        const size_t length = static_cast<size_t>(
+            std::min<uintmax_t>(window, size - file1.position()));
+        const MappedWindow map1(file1, length);
+        const MappedWindow map2(file2, length);
+        if (!map1.valid() || !map2.valid())
+        {
+            return MapResult::unmappable;
+        }
+        if (!memory_equal(map1.bytes(), map2.bytes(), length))
+        {
+            return MapResult::different;
+        }
+        file1.skip(length);
+        file2.skip(length);
+        window = std::min(window * 2, last_window);
+    }
+    return MapResult::equal;
+}
+#endif
+}
+
+struct FileReader::HashState {
+    const HashKernel &kernel;
+    void *const state;
+
+    HashState() : kernel(hash_kernel()), state(kernel.create_state()) {}
+    ~HashState() {kernel.free_state(state);}
+
+    HashState(const HashState &) = delete;
+    HashState &operator=(const HashState &) = delete;
+};
+
+void FileReader::AlignedDeleter::operator()(char *buffer) const
+{
+    ::operator delete[](buffer, alignment);
+}
+
+void FileReader::HashStateDeleter::operator()(HashState *state) const
+{
+    delete state;
+}
+
+FileReader::FileReader(size_t b_s, uintmax_t m_s)
+    : buffer_size(std::max(b_s, size_t(1))), map_size(m_s),
+      state(new HashState)
+{
+    for (auto &buffer : buffers)
+    {
+        buffer.reset(static_cast<char*>(
+            ::operator new[](buffer_size, alignment)));
+    }
+}
+
+template <typename Update>
+void FileReader::read_for_hash(const string &path, uintmax_t bytes,
+                               Update update)
+{
+    InputFile file(path);
+    if (bytes == 0)
+    {
+        file.expect_sequential();
+    }
+
+    char *const buffer = buffers[0].get();
+    uintmax_t left = bytes;
+    const auto next_length = [this, bytes, &left]
+    {
+        return bytes == 0
+            ? buffer_size
+            : static_cast<size_t>(std::min<uintmax_t>(left, buffer_size));
+    };
+    while (true)
+    {
+        const size_t count = file.read(buffer, next_length());
+        left -= count;
+        const bool more = count == buffer_size && (bytes == 0 || left > 0);
+        if (more)
+        {
+            // The next buffer is read while this one is hashed
+            file.prefetch(next_length());
+        }
+        update(buffer, count);
+        if (!more)
+        {
+            break;
+        }
+    }
+}
+
+uint64_t FileReader::hash(const string &path, uintmax_t bytes)
+{
+    const HashKernel &kernel = state->kernel;
+    kernel.reset64(state->state);
+    read_for_hash(path, bytes, [this, &kernel](const char *buffer,
+                                               size_t count)
+    {
+        kernel.update64(state->state, buffer, count);
+    });
+    return kernel.digest64(state->state);
+}
+
+Digest128 FileReader::hash128(const string &path)
+{
+    const HashKernel &kernel = state->kernel;
+    kernel.reset128(state->state);
+    read_for_hash(path, 0, [this, &kernel](const char *buffer, size_t count)
+    {
+        kernel.update128(state->state, buffer, count);
+    });
+    Digest128 digest;
+    kernel.digest128(state->state, digest.low, digest.high);
+    return digest;
+}
+
+uint64_t FileReader::hash_blocks(const string &path,
+                                 const uintmax_t *offsets,
+                                 size_t offset_count, size_t length)
+{
+    InputFile file(path);
+    const HashKernel &kernel = state->kernel;
+    kernel.reset64(state->state);
+
+    char *const buffer = buffers[0].get();
+    for (size_t i = 0; i < offset_count; ++i)
+    {
+        const uintmax_t offset = offsets[i];
+        // Blocks may overlap in small files, and the overlap is read once
+        const uintmax_t start = std::max(offset, file.position());
+        if (offset + length <= start)
+        {
+            continue;
+        }
+        file.skip(start - file.position());
+        size_t left = static_cast<size_t>(offset + length - start);
+        while (left > 0)
+        {
+            const size_t count = file.read(buffer, std::min(left, buffer_size));
+            kernel.update64(state->state, buffer, count);
+            if (count < std::min(left, buffer_size))
+            {
+                return kernel.digest64(state->state);
+            }
+            left -= count;
+        }
+    }
+    return kernel.digest64(state->state);
+}
+
+bool FileReader::compare(const string &path1, const string &path2)
+{
+    InputFile file1(path1);
+    InputFile file2(path2);
+#ifdef __linux__
+    if (map_size != 0)
+    {
+        const uintmax_t size = file1.size();
+        if (size != file2.size())
+        {
+            return false;
+        }
+        if (size >= map_size)
+        {
+            const MapResult result = compare_mapped(file1, file2, size);
+            if (result != MapResult::unmappable)
+            {
+                return result == MapResult::equal;
+            }
+        }
+    }
+#endif
+    file1.expect_sequential();
+    file2.expect_sequential();
+
+    char *const buffer1 = buffers[0].get();
+    char *const buffer2 = buffers[1].get();
+    while (true)
+    {
+        const size_t count1 = file1.read(buffer1, buffer_size);
+        const size_t count2 = file2.read(buffer2, buffer_size);
+        if (count1 != count2)
+        {
+            return false;
+        }
+        const bool more = count1 == buffer_size;
+        if (more)
+        {
+            // The next buffers are read while these are compared
+            file1.prefetch(buffer_size);
+            file2.prefetch(buffer_size);
+        }
+        if (!memory_equal(buffer1, buffer2, count1))
+        {
+            return false;
+        }
+        if (!more)
+        {
+            return true;
+        }
+    }
+}
+
+void FileReader::read_beginning(const string &path, char *beginning,
+                                size_t bytes)
+{
+    InputFile file(path);
+    const size_t count = file.read(beginning, bytes);
+    std::fill(beginning + count, beginning + bytes, 0);
+}
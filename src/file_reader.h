@@ -0,0 +1,104 @@
+#ifndef FILE_READER_H
+#define FILE_READER_H
+
+#include "utilities.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/**
+ * Reads files for hashing and comparison. The buffers and the hash state are
+ * allocated once and reused for every file, so a reader should be kept for
+ * as long as files are read. Not thread safe, so each thread should have its
+ * own reader.
+ *
+ * Files are read sequentially a buffer at a time. Before a buffer is hashed
+ * or compared, the kernel is asked to start reading the next one, so reading
+ * the file overlaps with processing it.
+ */
+class FileReader {
+        struct AlignedDeleter {
+            void operator()(char *buffer) const;
+        };
+        using Buffer = std::unique_ptr<char[], AlignedDeleter>;
+
+        struct HashState;
+        struct HashStateDeleter {
+            void operator()(HashState *state) const;
+        };
+
+        std::size_t buffer_size;
+        uintmax_t map_size;
+        Buffer buffers[2];
+        std::unique_ptr<HashState, HashStateDeleter> state;
+
+        /**
+         * Reads the beginning of the given file, as in hash, and passes each
+         * buffer to the given function.
+         */
+        template <typename Update>
+        void read_for_hash(const std::string &path, uintmax_t bytes,
+                           Update update);
+
+    public:
+        /**
+         * Default size of each of the two buffers.
+         */
+        static constexpr std::size_t default_buffer_size = 256 * 1024;
+
+        /**
+         * Files that are at least m_s bytes long are compared through memory
+         * maps instead of being read into the buffers. If m_s == 0, or if the
+         * system is not Linux, memory maps are not used.
+         */
+        explicit FileReader(std::size_t b_s = default_buffer_size,
+                            uintmax_t m_s = 0);
+
+        /**
+         * Returns the 64-bit XXHash digest of the beginning of the file in the
+         * given path. Parameter "bytes" specifies the number of bytes that
+         * are considered. If bytes == 0, the whole file is hashed.
+         * Throws FileException if the file can't be read.
+         */
+        uint64_t hash(const std::string &path, uintmax_t bytes);
+
+        /**
+         * Returns the 128-bit XXHash digest of the whole file in the given
+         * path. Throws FileException if the file can't be read.
+         */
+        Digest128 hash128(const std::string &path);
+
+        /**
+         * Returns the 64-bit XXHash digest of blocks of the file in the
+         * given path, each of the given length, at the given number of
+         * ascending offsets. Blocks are cut short at the end of the file.
+         * Throws FileException if the file can't be read.
+         */
+        uint64_t hash_blocks(const std::string &path,
+                             const uintmax_t *offsets,
+                             std::size_t offset_count, std::size_t length);
+
+        /**
+         * Returns true if the contents of the files in the given paths are
+         * exactly the same. Throws FileException if a file can't be read.
+         *
+         * Memory maps avoid copying the files, and they are compared in
+         * windows that grow as long as the files match. Files that can't be
+         * mapped are read into the buffers instead. A mapped file that is
+         * truncated during the comparison terminates the program with
+         * SIGBUS, which is why maps are only used when asked for.
+         */
+        bool compare(const std::string &path1, const std::string &path2);
+
+        /**
+         * Reads the given number of bytes from the beginning of the given
+         * file into the given memory, padded with zeros if the file is
+         * shorter. Throws FileException if the file can't be read.
+         */
+        void read_beginning(const std::string &path, char *beginning,
+                            std::size_t bytes);
+};
+
+#endif // FILE_READER_H
@@ -5,17 +5,26 @@
 
 #include <vector>
 
+/**
+ * Policy that the engines hash files with, which also decides when digests
+ * can be trusted without comparing the files. Defined in hasher.h.
+ */
 template <typename T>
-std::vector<DuplicateVector> find_duplicates_map(const ArgMap &cl_args);
+struct Hasher;
 
-template <typename T>
-std::vector<DuplicateVector> find_duplicates_map_two(const ArgMap &cl_args);
+template <typename T, typename H = Hasher<T>>
+Duplicates find_duplicates_map(const ArgMap &cl_args);
 
-template <typename T>
-std::vector<DuplicateVector> find_duplicates_vector(const ArgMap &cl_args);
+template <typename T, typename H = Hasher<T>>
+Duplicates find_duplicates_map_two(const ArgMap &cl_args);
 
-std::vector<DuplicateVector> find_duplicates_vector_no_hash(
-                                const ArgMap &cl_args);
+template <typename T, typename H = Hasher<T>>
+Duplicates find_duplicates_vector(const ArgMap &cl_args);
+
+Duplicates find_duplicates_vector_no_hash(const ArgMap &cl_args);
+
+template <typename T, typename H = Hasher<T>>
+Duplicates find_duplicates_external(const ArgMap &cl_args);
 
 /**
  * Finds duplicate files from the given paths.
@@ -23,15 +32,19 @@ std::vector<DuplicateVector> find_duplicates_vector_no_hash(
  * Path can be a file or a directory.
  * Directories can be searched recursively, according to the given parameter.
  * 
- * Returns a vector whose elements are vectors of duplicate files.
+ * Returns the sets of duplicate files.
  */
 template <typename T>
-inline std::vector<DuplicateVector> find_duplicates(const ArgMap &cl_args)
+inline Duplicates find_duplicates(const ArgMap &cl_args)
 {
     if (std::get<bool>(cl_args.at("no-hash")))
     {
         return find_duplicates_vector_no_hash(cl_args);
     }
+    else if (std::get<uintmax_t>(cl_args.at("external-memory")) != 0)
+    {
+        return find_duplicates_external<T>(cl_args);
+    }
     else if (std::get<bool>(cl_args.at("vector")))
     {
         return find_duplicates_vector<T>(cl_args);
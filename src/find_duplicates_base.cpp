@@ -1,7 +1,22 @@
 #include "find_duplicates_base.h"
+#include "hash_kernel.h"
+#include "memory_compare.h"
+#include "size_sketch.h"
+#include "traverse.h"
+#include "uring_hasher.h"
 
+#include <algorithm>
+#include <exception>
 #include <iostream>
 #include <filesystem>
+#include <limits>
+#include <memory>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 using std::cerr;
 using std::cout;
@@ -9,9 +24,42 @@ using std::endl;
 
 namespace fs = std::filesystem;
 
+namespace {
+/**
+ * Identifies a file by the device it is on and its inode number. All hard 
+ * links to a file have the same identity.
+ */
+struct FileIdentity {
+    uintmax_t device;
+    uintmax_t inode;
+    bool operator==(const FileIdentity &other) const
+    {
+        return device == other.device && inode == other.inode;
+    }
+};
+
+struct FileIdentityHash {
+    size_t operator()(const FileIdentity &identity) const
+    {
+        return std::hash<uintmax_t>()(identity.inode) 
+            ^ (std::hash<uintmax_t>()(identity.device) << 1);
+    }
+};
+
+/**
+ * Returns false if the hash of the beginning of a file of the given size is
+ * not used, because the whole file is hashed with a 128-bit digest instead.
+ */
+bool prefix_hash_used(uintmax_t size, const ArgMap &cl_args)
+{
+    const uintmax_t bytes = std::get<uintmax_t>(cl_args.at("bytes"));
+    return std::get<int>(cl_args.at("hash")) != 16
+        || (bytes != 0 && size > bytes);
+}
+
 /**
  * Manages the scanning that is done before deduplication. Files are counted and
- * their paths and last modification times are collected.
+ * their metadata is collected in a catalog.
  */
 class ScanManager {
         // size_t can store the maximum size of a theoretically possible object 
@@ -21,116 +69,218 @@ class ScanManager {
         // order to not limit file size by type choice.
         uintmax_t size;
         FileSizeTable &file_size_table;
+        FileCatalog &files;
+        // Hashes the beginnings of files of non-unique size, if pipelined
+        PrefixHasher *hasher;
+        const ArgMap &cl_args;
+        // Files with extra hard links that have been inserted
+        std::unordered_map<FileIdentity, FileId, FileIdentityHash> 
+            linked_files;
     public:
-        ScanManager(FileSizeTable &f)
-            : count(0), size(0), file_size_table(f) {};
+        ScanManager(FileSizeTable &f, FileCatalog &c, PrefixHasher *h,
+                    const ArgMap &a)
+            : count(0), size(0), file_size_table(f), files(c), hasher(h),
+              cl_args(a) {};
 
-        void insert(const fs::directory_entry &entry, size_t number_of_path)
+        void insert(std::vector<ScannedFile> &batch)
         {
-            try
+            for (auto &scanned : batch)
             {
-                fs::path path = entry.path();
-                // Symlinks and empty files are skipped
-                if (fs::is_regular_file(fs::symlink_status(path))
-                    && !fs::is_empty(path))
+                try
                 {
-                    auto file_size = entry.file_size();
-                    // If a file's hard link count is 1, it doesn't have extra
-                    // hard links
-                    if (fs::hard_link_count(path) > 1)
+                    insert(scanned);
+                }
+                catch(const fs::filesystem_error &e)
+                {
+                    cerr << e.what() << '\n';
+                }
+                catch(const std::exception& e)
+                {
+                    cerr << e.what() << '\n';
+                }
+            }
+        }
+
+        size_t get_count() const {return count;}
+        uintmax_t get_size() const {return size;}
+
+    private:
+        void insert(ScannedFile &scanned)
+        {
+            auto &same_size = file_size_table[scanned.size];
+            // If a file's hard link count is 1, it doesn't have extra hard 
+            // links
+            if (scanned.has_extra_links)
+            {
+                const FileId *linked = find_linked_file(scanned, same_size);
+                if (linked != nullptr)
+                {
+                    // The file to be inserted is an extra hard link to an
+                    // already inserted file. Files are found in no
+                    // particular order, so keep the link that is in the
+                    // path given first.
+                    if (scanned.number_of_path < files.number_of_path(*linked))
                     {
-                        for (auto &file : file_size_table[file_size])
-                        {
-                            if (fs::equivalent(path, fs::path(file.path)))
-                            {
-                                // The file to be inserted is an extra hard link
-                                // to an already inserted file, so skip it
-                                return;
-                            }
-                        }
+                        files.relink(*linked, scanned.path, 
+                                     scanned.number_of_path);
                     }
-                    
-                    file_size_table[file_size]
-                        .push_back(File(path.string(), 
-                                        entry.last_write_time(),
-                                        number_of_path));
-                    ++count;
-                    size += file_size;
+                    return;
                 }
             }
-            catch(const fs::filesystem_error &e)
+
+            const FileId id = files.add(scanned);
+            same_size.push_back(id);
+            if (scanned.has_extra_links && scanned.inode != 0)
             {
-                cerr << e.what() << '\n';
+                linked_files.emplace(
+                    FileIdentity{scanned.device, scanned.inode}, id);
             }
-            catch(const std::runtime_error &e)
+            ++count;
+            size += scanned.size;
+
+            if (hasher != nullptr && same_size.size() > 1
+                && prefix_hash_used(scanned.size, cl_args))
             {
-                cerr << e.what() << " [" << entry.path().string() << "]\n";
+                // The second file of a size makes the size group a candidate
+                // for deduplication, so the first file must be hashed too
+                if (same_size.size() == 2)
+                {
+                    hasher->push(same_size[0], files.path(same_size[0]));
+                }
+                hasher->push(same_size.back(), files.path(same_size.back()));
             }
-            catch(const std::exception& e)
+        }
+
+        /**
+         * Returns the already inserted file that the given file is a hard link
+         * to, or nullptr if there is none.
+         */
+        const FileId *find_linked_file(const ScannedFile &scanned,
+                                       const SizeGroup &same_size) const
+        {
+            if (scanned.inode != 0)
             {
-                cerr << e.what() << '\n';
+                const auto linked = linked_files.find(
+                    FileIdentity{scanned.device, scanned.inode});
+                return linked == linked_files.end() ? nullptr
+                                                    : &linked->second;
             }
-        }
 
-        size_t get_count() const {return count;}
-        uintmax_t get_size() const {return size;}
+            // Without an identity the files must be compared by path
+            for (const auto &id : same_size)
+            {
+                if (fs::equivalent(files.paths().path(scanned.path), 
+                                   files.path(id)))
+                {
+                    return &id;
+                }
+            }
+            return nullptr;
+        }
 };
 
 /**
- * Traverses the given path and collects information about files.
- * Directories are traversed recursively if wanted.
+ * Returns false if the hashes of file beginnings are not used, because the 
+ * whole files are hashed with 128-bit digests instead.
  */
-void scan_path(const fs::path &path, bool recurse, ScanManager &sm, 
-               size_t number_of_path)
+bool prefix_hashes_used(const ArgMap &cl_args)
 {
-    if (fs::is_directory(path))
+    return std::get<int>(cl_args.at("hash")) != 16 
+        || std::get<uintmax_t>(cl_args.at("bytes")) != 0;
+}
+}
+
+size_t scan_all_paths(FileCatalog &files, FileSizeTable &file_size_table,
+                      const ArgMap &cl_args, PrefixHashes *prefix_hashes)
+{
+    if (std::get<bool>(cl_args.at("verbose")))
     {
-        // Directories that cannot be accessed are skipped
-        if (recurse)
-        {
-            for (const auto &p : fs::recursive_directory_iterator(path, 
-                fs::directory_options::skip_permission_denied))
-            {
-                sm.insert(p, number_of_path);
-            }
-        }
-        else
-        {
-            for (const auto &p : fs::directory_iterator(path, 
-                fs::directory_options::skip_permission_denied))
-            {
-                sm.insert(p, number_of_path);
-            }
-        }
+        cout << "Hash kernel: " << hash_kernel().name
+             << ", comparison kernel: " << memory_equal_kernel() << endl;
     }
-    else
+    cout << "Counting number and size of files in given paths..." << endl;
+    std::unique_ptr<PrefixHasher> hasher;
+    if (prefix_hashes != nullptr && std::get<bool>(cl_args.at("pipeline"))
+        && prefix_hashes_used(cl_args))
     {
-        sm.insert(fs::directory_entry(path), number_of_path);
+        hasher = std::make_unique<PrefixHasher>(
+            std::get<uintmax_t>(cl_args.at("bytes")),
+            std::get<uintmax_t>(cl_args.at("buffer-size")));
     }
-}
+    ScanManager sm = ScanManager(file_size_table, files, hasher.get(),
+                                 cl_args);
 
-size_t scan_all_paths(FileSizeTable &file_size_table, const ArgMap &cl_args)
-{
-    cout << "Counting number and size of files in given paths..." << endl;
-    ScanManager sm = ScanManager(file_size_table);
-    
-    const bool recurse = std::get<bool>(cl_args.at("recurse"));
-    size_t number_of_path = 0; // Used in deciding which file to keep when 
-                               // deleting or linking without prompting
-    for (const auto &path : 
-         std::get<std::vector<fs::path>>(cl_args.at("paths")))
+    // The index of a path is used in deciding which file to keep when 
+    // deleting or linking without prompting
+    TraversalOptions options{
+        std::get<bool>(cl_args.at("recurse")),
+        std::get<uintmax_t>(cl_args.at("scan-threads")),
+        static_cast<unsigned>(
+            std::get<uintmax_t>(cl_args.at("scan-queue-depth"))),
+        std::get<bool>(cl_args.at("one-file-system")),
+        ScanFilter()
+    };
+    options.filter.min_size = std::get<uintmax_t>(cl_args.at("min-size"));
+    options.filter.max_size = std::get<uintmax_t>(cl_args.at("max-size"));
+    for (const auto &pattern : 
+         std::get<std::vector<std::string>>(cl_args.at("include")))
     {
-        try
-        {
-            scan_path(path, recurse, sm, number_of_path);
-        }
-        catch(const std::exception &e)
-        {
-            cerr << e.what() << '\n';
-        }
-        ++number_of_path;
+        options.filter.include.emplace_back(pattern);
+    }
+    for (const auto &pattern : 
+         std::get<std::vector<std::string>>(cl_args.at("exclude")))
+    {
+        options.filter.exclude.emplace_back(pattern);
     }
+    const auto &paths = std::get<std::vector<fs::path>>(cl_args.at("paths"));
+
+    // The first pass of a low-memory scan only records the sizes of the 
+    // files, so that the second pass can skip the files of unique size
+    // before their paths and metadata are stored. Extra hard links are 
+    // left out as in the second pass, so that a size shared only by the
+    // links of one file stays unique.
+    SizeSketch sizes;
+    if (std::get<bool>(cl_args.at("low-memory")))
+    {
+        TraversalOptions size_options = options;
+        size_options.store_names = false;
+        PathStore directories;
+        std::unordered_set<FileIdentity, FileIdentityHash> linked_files;
+        traverse_paths(paths, size_options, directories,
+                       [&sizes, &linked_files](
+                           std::vector<ScannedFile> &batch)
+                       {
+                           for (const auto &scanned : batch)
+                           {
+                               if (scanned.has_extra_links 
+                                   && scanned.inode != 0
+                                   && !linked_files.insert(FileIdentity{
+                                          scanned.device, 
+                                          scanned.inode}).second)
+                               {
+                                   continue;
+                               }
+                               sizes.add(scanned.size);
+                           }
+                       });
+        cout << "Skipping " << sizes.drop_unique() << " files with unique "
+                "size." << endl;
+        options.filter.sizes = &sizes;
+    }
+
+    traverse_paths(paths,
+                   options,
+                   files.paths(),
+                   [&sm](std::vector<ScannedFile> &batch)
+                   {
+                       sm.insert(batch);
+                   });
     
+    if (hasher)
+    {
+        hasher->finish(*prefix_hashes);
+    }
+
     const size_t total_count = sm.get_count();
     const uintmax_t total_size = sm.get_size();
     cout << "Counted " << total_count << " files occupying "
@@ -165,9 +315,71 @@ size_t skip_files_with_unique_size(FileSizeTable &file_size_table)
     return no_fls_with_uniq_sz;
 }
 
+bool compare_in_memory(size_t count, uintmax_t size, const ArgMap &cl_args)
+{
+    const uintmax_t bytes = std::get<uintmax_t>(cl_args.at("bytes"));
+    const uintmax_t memory = thread_share(
+        std::get<uintmax_t>(cl_args.at("compare-memory")), cl_args);
+    return (bytes == 0 || size <= bytes) && size <= memory 
+        && count <= memory / size;
+}
+
+void hash_prefixes(const FileSizeTable &file_size_table, 
+                   const FileCatalog &files, const ArgMap &cl_args,
+                   PrefixHashes &prefix_hashes)
+{
+#ifdef __linux__
+    const auto queue_depth = static_cast<unsigned>(
+        std::get<uintmax_t>(cl_args.at("hash-queue-depth")));
+    if (queue_depth == 0 || !prefix_hashes_used(cl_args))
+    {
+        return;
+    }
+
+    // Files are hashed in the order they were found, which keeps the reads
+    // of a directory close together
+    std::vector<FileId> ids;
+    for (const auto &same_size : file_size_table)
+    {
+        if (compare_in_memory(same_size.second.size(), same_size.first, 
+                              cl_args)
+            || !prefix_hash_used(same_size.first, cl_args))
+        {
+            continue;
+        }
+        for (const auto id : same_size.second)
+        {
+            if (!prefix_hashes.contains(id))
+            {
+                ids.push_back(id);
+            }
+        }
+    }
+    std::sort(ids.begin(), ids.end());
+
+    try
+    {
+        UringHasher hasher(queue_depth, 
+            std::get<uintmax_t>(cl_args.at("bytes")),
+            std::get<uintmax_t>(cl_args.at("buffer-size")));
+        hasher.hash(ids, files, prefix_hashes);
+    }
+    catch(const std::system_error &e)
+    {
+        cerr << "io_uring is not available (" << e.what()
+             << "), reading files synchronously\n";
+    }
+#else
+    (void)file_size_table;
+    (void)files;
+    (void)cl_args;
+    (void)prefix_hashes;
+#endif
+}
+
 void print_progress(size_t curr_f_cnt, size_t tot_f_cnt, size_t step_size)
 {
-    if (step_size > 0 
+    if (step_size > 0 && tot_f_cnt > 0
         && (curr_f_cnt % step_size == 0 || curr_f_cnt == tot_f_cnt))
     {
         const float progress = static_cast<float>(curr_f_cnt) 
@@ -177,3 +389,201 @@ void print_progress(size_t curr_f_cnt, size_t tot_f_cnt, size_t step_size)
         cout.flush();
     }
 }
+
+Progress::Progress(size_t t_c)
+    : current_count(0), total_count(t_c), 
+      step_size(t_c / 20 + 1), printed_count(0)
+{
+}
+
+void Progress::advance()
+{
+    const size_t count = ++current_count;
+    if (count % step_size == 0 || count == total_count)
+    {
+        // Another thread may have counted further and printed already
+        std::lock_guard<std::mutex> lock(mutex);
+        if (count > printed_count)
+        {
+            printed_count = count;
+            print_progress(count, total_count, step_size);
+        }
+    }
+}
+
+SpareThreads::SpareThreads(std::atomic<unsigned> &s, unsigned wanted)
+    : spare(s), count(0)
+{
+    // Another worker may take some of the threads in between
+    unsigned available = spare.load();
+    while (!spare.compare_exchange_weak(available,
+                                        available - std::min(available,
+                                                             wanted)))
+    {
+    }
+    count = std::min(available, wanted);
+}
+
+SpareThreads::~SpareThreads()
+{
+    spare += count;
+}
+
+DedupWorker::DedupWorker(const FileCatalog &files, const ArgMap &cl_args,
+                         Progress &p, std::atomic<unsigned> &spare)
+    : reader(std::get<uintmax_t>(cl_args.at("buffer-size")),
+             std::get<uintmax_t>(cl_args.at("mmap"))),
+      verifier(files, reader, 
+               std::get<uintmax_t>(cl_args.at("buffer-size")),
+               static_cast<size_t>(thread_share(
+                   std::get<uintmax_t>(cl_args.at("open-files")), cl_args)),
+               static_cast<size_t>(thread_share(
+                   std::get<uintmax_t>(cl_args.at("compare-memory")),
+                   cl_args))),
+      progress(p), arena_buffer(new char[arena_size]),
+      arena(arena_buffer.get(), arena_size), spare_threads(spare)
+{
+}
+
+unsigned thread_count(const ArgMap &cl_args)
+{
+    const uintmax_t threads = std::get<uintmax_t>(cl_args.at("hash-threads"));
+    if (threads == 0)
+    {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+    return static_cast<unsigned>(
+        std::min<uintmax_t>(threads, std::numeric_limits<unsigned>::max()));
+}
+
+uintmax_t thread_share(uintmax_t budget, const ArgMap &cl_args)
+{
+    if (budget == 0)
+    {
+        return 0;
+    }
+    return std::max<uintmax_t>(1, budget / thread_count(cl_args));
+}
+
+std::vector<DuplicateVector> deduplicate_groups(
+    const std::vector<const SizeGroup *> &groups, const FileCatalog &files,
+    const ArgMap &cl_args, Progress &progress,
+    const SizeGroupFunction &function)
+{
+    // Large groups are started first, so that a thread doesn't get one at
+    // the end while the others are idle
+    std::vector<size_t> order(groups.size());
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [&groups](size_t a, size_t b)
+                     {
+                         return groups[a]->size() > groups[b]->size();
+                     });
+
+    const size_t threads = std::max(size_t(1),
+        std::min(size_t(thread_count(cl_args)), groups.size()));
+
+    // The sets of each thread with the indices of their groups, which only
+    // allocate when they grow, and the sets of all threads
+    using GroupSet = std::pair<size_t, DuplicateVector>;
+    std::vector<GroupSet> results;
+    std::mutex results_mutex;
+    std::atomic<size_t> next(0);
+    // Threads that are not started for lack of groups, and workers that
+    // have no more groups, are lent to the workers that are still busy
+    std::atomic<unsigned> spare_threads(
+        static_cast<unsigned>(thread_count(cl_args) - threads));
+    const auto run = [&]()
+    {
+        DedupWorker worker(files, cl_args, progress, spare_threads);
+        std::vector<DuplicateVector> sets;
+        std::vector<GroupSet> worker_results;
+        for (size_t i = next++; i < order.size(); i = next++)
+        {
+            const SizeGroup &group = *groups[order[i]];
+            try
+            {
+                const uintmax_t size = files.size(group[0]);
+                if (compare_in_memory(group.size(), size, cl_args))
+                {
+                    worker.verifier.verify_in_memory(group.data(),
+                        group.size(), size, sets);
+                    for (size_t j = 0; j < group.size(); ++j)
+                    {
+                        worker.progress.advance();
+                    }
+                }
+                else
+                {
+                    function(group, worker, sets);
+                }
+            }
+            catch(const std::exception &e)
+            {
+                cerr << e.what() << '\n';
+            }
+            for (auto &identicals : sets)
+            {
+                worker_results.emplace_back(order[i], std::move(identicals));
+            }
+            sets.clear();
+            // The containers of the group go all at once
+            worker.arena.release();
+        }
+        ++spare_threads;
+
+        std::lock_guard<std::mutex> lock(results_mutex);
+        for (auto &result : worker_results)
+        {
+            results.push_back(std::move(result));
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t worker = 1; worker < threads; ++worker)
+    {
+        workers.emplace_back(run);
+    }
+    run();
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+
+    // Each group was deduplicated by one thread, which kept the order of
+    // its sets
+    std::stable_sort(results.begin(), results.end(),
+                     [](const GroupSet &a, const GroupSet &b)
+                     {
+                         return a.first < b.first;
+                     });
+    std::vector<DuplicateVector> sets;
+    sets.reserve(results.size());
+    for (auto &result : results)
+    {
+        sets.push_back(std::move(result.second));
+    }
+    return sets;
+}
+
+std::vector<DuplicateVector> deduplicate_size_groups(
+    FileSizeTable &file_size_table, const FileCatalog &files, 
+    const ArgMap &cl_args, size_t total_count, 
+    const SizeGroupFunction &function)
+{
+    std::vector<const SizeGroup *> groups;
+    groups.reserve(file_size_table.size());
+    for (const auto &same_size : file_size_table)
+    {
+        groups.push_back(&same_size.second);
+    }
+
+    Progress progress(total_count);
+    auto sets = deduplicate_groups(groups, files, cl_args, progress,
+                                   function);
+    file_size_table.clear();
+    return sets;
+}
@@ -1,22 +1,45 @@
 #ifndef FIND_DUPLICATES_BASE_H
 #define FIND_DUPLICATES_BASE_H
 
+#include "file_reader.h"
 #include "find_duplicates.h"
+#include "group_verifier.h"
+#include "prefix_hasher.h"
 
+#include <atomic>
+#include <functional>
 #include <iostream>
 #include <filesystem>
+#include <memory_resource>
+#include <mutex>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
 /**
- * Stores Files grouped by their size. Used during the file scanning phase.
+ * Ids of files of the same size.
  */
-using FileSizeTable = std::unordered_map<uintmax_t, std::vector<File>>;
+using SizeGroup = std::pmr::vector<FileId>;
 
 /**
- * Scans all the paths that were given as command line arguments.
+ * Stores file ids grouped by file size. Used during the file scanning phase.
+ * The engines allocate the table and its groups from a monotonic arena, so
+ * that the memory is released in one step when the deduplication is over,
+ * instead of node by node.
  */
-size_t scan_all_paths(FileSizeTable &file_size_table, const ArgMap &cl_args);
+using FileSizeTable = std::pmr::unordered_map<uintmax_t, SizeGroup>;
+
+/**
+ * Scans all the paths that were given as command line arguments. The metadata
+ * of the found files is stored in the given catalog.
+ * 
+ * If prefix hashes are given and the argument 'pipeline' is specified, the 
+ * beginnings of files are hashed while the scan continues, as soon as another 
+ * file of the same size is found.
+ */
+size_t scan_all_paths(FileCatalog &files, FileSizeTable &file_size_table,
+                      const ArgMap &cl_args, 
+                      PrefixHashes *prefix_hashes = nullptr);
 
 /**
  * Files with unique size can't have duplicates. This function removes them
@@ -24,9 +47,150 @@ size_t scan_all_paths(FileSizeTable &file_size_table, const ArgMap &cl_args);
  */
 size_t skip_files_with_unique_size(FileSizeTable &file_size_table);
 
+/**
+ * Returns true if the given number of files of the given size are compared
+ * whole in memory, instead of being hashed and compared. This is the case 
+ * when the hashed beginnings would cover the whole files anyway, and the 
+ * files fit in the share of a thread of the memory given by the argument
+ * 'compare-memory'.
+ */
+bool compare_in_memory(size_t count, uintmax_t size, const ArgMap &cl_args);
+
+/**
+ * Hashes the beginnings of the files in the table with io_uring, if the 
+ * argument 'hash-queue-depth' is not zero. The hashes that are already known
+ * are not calculated again. On systems without io_uring nothing is done, and
+ * the files are hashed synchronously during the deduplication.
+ */
+void hash_prefixes(const FileSizeTable &file_size_table, 
+                   const FileCatalog &files, const ArgMap &cl_args,
+                   PrefixHashes &prefix_hashes);
+
 /**
  * Prints the progress on finding duplicates.
  */
 void print_progress(size_t curr_f_cnt, size_t tot_f_cnt, size_t step_size);
 
+/**
+ * Counts the files that have been checked and prints the progress. Can be
+ * advanced from several threads, and the printed count never goes backwards.
+ * A total count of 0 prints nothing.
+ */
+class Progress {
+        std::atomic<size_t> current_count;
+        const size_t total_count;
+        const size_t step_size;
+        std::mutex mutex;
+        size_t printed_count;
+
+    public:
+        explicit Progress(size_t t_c);
+
+        /**
+         * Counts one more file as checked.
+         */
+        void advance();
+};
+
+/**
+ * Threads of a pool that ran out of size groups, lent to a worker that can
+ * split its group between threads, such as for sorting it. At most the
+ * wanted number of threads is taken, and they are given back when the
+ * object is destroyed, so the pool never runs more threads than it has.
+ */
+class SpareThreads {
+        std::atomic<unsigned> &spare;
+        unsigned count;
+
+    public:
+        SpareThreads(std::atomic<unsigned> &s, unsigned wanted);
+        ~SpareThreads();
+
+        SpareThreads(const SpareThreads &) = delete;
+        SpareThreads &operator=(const SpareThreads &) = delete;
+
+        /**
+         * Returns the number of threads that were taken.
+         */
+        unsigned size() const {return count;}
+};
+
+/**
+ * State of a thread that deduplicates size groups. Each thread reads files
+ * with its own buffers. The threads share the limits given by the arguments
+ * 'open-files' and 'compare-memory', so each verifier gets its share.
+ *
+ * The containers that a size group needs only while it is deduplicated are
+ * allocated from the arena of the thread, which is released after each
+ * group. The arena starts with a buffer of its own, so that small groups
+ * don't allocate at all.
+ */
+struct DedupWorker {
+    static constexpr std::size_t arena_size = 256 * 1024;
+
+    FileReader reader;
+    GroupVerifier verifier;
+    Progress &progress;
+    std::unique_ptr<char[]> arena_buffer;
+    std::pmr::monotonic_buffer_resource arena;
+    // Full path of the file being read, whose memory is reused
+    std::string path;
+    // Threads of the pool that have no more groups to deduplicate
+    std::atomic<unsigned> &spare_threads;
+
+    DedupWorker(const FileCatalog &files, const ArgMap &cl_args, Progress &p,
+                std::atomic<unsigned> &spare);
+};
+
+/**
+ * Deduplicates the files of one size group and adds the sets of identical
+ * files in it to the given sets. The sets must not be allocated from the
+ * arena of the worker.
+ */
+using SizeGroupFunction = std::function<
+    void(const SizeGroup &, DedupWorker &, std::vector<DuplicateVector> &)
+>;
+
+/**
+ * Returns the number of threads given by the argument 'hash-threads', 0 meaning
+ * one thread per hardware thread.
+ */
+unsigned thread_count(const ArgMap &cl_args);
+
+/**
+ * Returns the share of each thread given by the argument 'hash-threads' of the
+ * given budget, such as a number of open files or bytes of memory. The share
+ * is at least 1, unless the budget is 0.
+ */
+uintmax_t thread_share(uintmax_t budget, const ArgMap &cl_args);
+
+/**
+ * Calls the given function for every given group of files of the same size,
+ * using the number of threads specified by the argument 'hash-threads'.
+ * Groups that are compared in memory are verified directly instead, and
+ * advance the given progress. Groups are handed to the threads largest
+ * first.
+ *
+ * Returns the sets of identical files of all groups, in the order of the
+ * given groups regardless of the number of threads.
+ */
+std::vector<DuplicateVector> deduplicate_groups(
+    const std::vector<const SizeGroup *> &groups, const FileCatalog &files,
+    const ArgMap &cl_args, Progress &progress,
+    const SizeGroupFunction &function);
+
+/**
+ * Calls the given function for every size group in the table, using the
+ * number of threads specified by the argument 'hash-threads'. Groups that are 
+ * compared in memory are verified directly instead. Groups are handed to
+ * the threads largest first. The table is emptied.
+ *
+ * Returns the sets of identical files of all groups, in the order of the
+ * groups in the table regardless of the number of threads.
+ */
+std::vector<DuplicateVector> deduplicate_size_groups(
+    FileSizeTable &file_size_table, const FileCatalog &files, 
+    const ArgMap &cl_args, size_t total_count, 
+    const SizeGroupFunction &function);
+
 #endif // FIND_DUPLICATES_BASE_H
\ No newline at end of file
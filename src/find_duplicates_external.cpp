@@ -0,0 +1,302 @@
+#include "external_sort.h"
+#include "file_reader.h"
+#include "find_duplicates_base.h"
+#include "hasher.h"
+#include "utilities.h"
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <memory_resource>
+#include <mutex>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::vector;
+
+namespace fs = std::filesystem;
+
+namespace {
+/**
+ * A candidate for deduplication: a file of the given size whose beginning
+ * has the given digest. The id refers to the path of the file in the
+ * catalog. Candidates are ordered by size and digest, so that candidates
+ * that may be identical come together, and by id, so that the order doesn't
+ * depend on how the candidates were sorted.
+ */
+template <typename T>
+struct Candidate {
+    uintmax_t size;
+    T digest;
+    FileId id;
+
+    bool same_group(const Candidate &other) const
+    {
+        return size == other.size && digest == other.digest;
+    }
+
+    bool operator<(const Candidate &other) const
+    {
+        if (size != other.size)
+        {
+            return size < other.size;
+        }
+        if (digest != other.digest)
+        {
+            return digest < other.digest;
+        }
+        return id < other.id;
+    }
+};
+
+/**
+ * Hashes the files of a size group into candidates, and advances the
+ * progress. Files are hashed with the hasher policy H.
+ */
+template <typename T, typename H = Hasher<T>>
+class DedupManager {
+        std::pmr::vector<Candidate<T>> &candidates;
+        const FileCatalog &files;
+        const PrefixHashes &prefix_hashes;
+        DedupWorker &worker;
+        const uintmax_t bytes;
+
+    public:
+        DedupManager(std::pmr::vector<Candidate<T>> &c, const FileCatalog &f,
+                     const PrefixHashes &p, DedupWorker &w, uintmax_t b)
+            : candidates(c), files(f), prefix_hashes(p), worker(w),
+              bytes(b) {};
+
+        void insert(FileId file)
+        {
+            try
+            {
+                candidates.push_back(Candidate<T>{files.size(file),
+                    H::prefix(file, files, prefix_hashes, bytes,
+                              worker.reader, worker.path),
+                    file});
+            }
+            catch(const fs::filesystem_error &e)
+            {
+                cerr << e.what() << '\n';
+            }
+            catch(const std::runtime_error &e)
+            {
+                cerr << e.what() << " [" << files.path(file) << "]\n";
+            }
+            catch(const std::exception& e)
+            {
+                cerr << e.what() << '\n';
+            }
+            worker.progress.advance();
+        }
+};
+}
+
+/**
+ * Candidates are written to the runs field by field, leaving out the padding
+ * between the fields.
+ */
+template <typename T>
+struct RunFormat<Candidate<T>> {
+    static_assert(std::has_unique_object_representations_v<T>,
+                  "Digests with padding need a RunFormat of their own");
+
+    static constexpr size_t size =
+        sizeof(uintmax_t) + sizeof(T) + sizeof(FileId);
+
+    static void write(const Candidate<T> &candidate, unsigned char *data)
+    {
+        std::memcpy(data, &candidate.size, sizeof(uintmax_t));
+        data += sizeof(uintmax_t);
+        std::memcpy(data, &candidate.digest, sizeof(T));
+        data += sizeof(T);
+        std::memcpy(data, &candidate.id, sizeof(FileId));
+    }
+
+    static void read(const unsigned char *data, Candidate<T> &candidate)
+    {
+        std::memcpy(&candidate.size, data, sizeof(uintmax_t));
+        data += sizeof(uintmax_t);
+        std::memcpy(&candidate.digest, data, sizeof(T));
+        data += sizeof(T);
+        std::memcpy(&candidate.id, data, sizeof(FileId));
+    }
+};
+
+/**
+ * Finds duplicate files from the given paths, keeping the candidates for
+ * deduplication within the memory limit given by the argument
+ * 'external-memory'.
+ *
+ * The candidates are sorted externally: when they don't fit in memory, they
+ * are written to temporary files in sorted runs, which are then merged.
+ * The candidates come out of the merge grouped by size and digest, and the
+ * groups are verified by the threads in batches that take about as much
+ * memory as the candidates.
+ *
+ * Returns the sets of duplicate files.
+ */
+template <typename T, typename H>
+Duplicates find_duplicates_external(const ArgMap &cl_args)
+{
+    // The table of the scan is released in one step
+    std::pmr::monotonic_buffer_resource scan_arena;
+    FileSizeTable file_size_table(&scan_arena);
+    Duplicates duplicates;
+    PrefixHashes prefix_hashes;
+
+    // Start by scanning the paths for files
+    const size_t total_count = scan_all_paths(duplicates.files,
+        file_size_table, cl_args, &prefix_hashes);
+
+    // Files with unique size can't have duplicates
+    const size_t no_fls_with_uniq_sz =
+        skip_files_with_unique_size(file_size_table);
+
+    const size_t total_non_unique_sz_count = total_count - no_fls_with_uniq_sz;
+
+    const uintmax_t bytes = std::get<uintmax_t>(cl_args.at("bytes"));
+    hash_prefixes(file_size_table, duplicates.files, cl_args, prefix_hashes);
+    const bool trust_hash = std::get<bool>(cl_args.at("trust-hash"));
+
+    // The threads hash the files of each size group, and the candidates are
+    // added to the sorter one group at a time. Groups that are compared in
+    // memory are verified directly.
+    ExternalSorter<Candidate<T>> sorter(static_cast<size_t>(
+        std::get<uintmax_t>(cl_args.at("external-memory"))));
+    std::mutex sorter_mutex;
+    // Candidates that can't be written would be lost, so the error ends the
+    // deduplication instead of only the size group
+    std::exception_ptr sorter_error;
+    duplicates.sets = deduplicate_size_groups(file_size_table,
+        duplicates.files, cl_args, total_non_unique_sz_count,
+        [&](const SizeGroup &same_size, DedupWorker &worker,
+            vector<DuplicateVector> &)
+        {
+            std::pmr::vector<Candidate<T>> candidates(&worker.arena);
+            candidates.reserve(same_size.size());
+            DedupManager<T, H> dm = DedupManager<T, H>(candidates,
+                duplicates.files, prefix_hashes, worker, bytes);
+            for (const auto file : same_size)
+            {
+                dm.insert(file);
+            }
+            std::lock_guard<std::mutex> lock(sorter_mutex);
+            try
+            {
+                for (const auto &candidate : candidates)
+                {
+                    sorter.add(candidate);
+                }
+            }
+            catch(...)
+            {
+                if (!sorter_error)
+                {
+                    sorter_error = std::current_exception();
+                }
+            }
+        });
+    if (sorter_error)
+    {
+        std::rethrow_exception(sorter_error);
+    }
+
+    // Compare the whole content of files that have the same size and hash,
+    // unless the hash is trusted. The groups are collected from the merge
+    // into batches, which are verified by the threads like size groups.
+    const size_t batch_limit = static_cast<size_t>(std::max<uintmax_t>(1,
+        std::get<uintmax_t>(cl_args.at("external-memory")) / sizeof(FileId)));
+    std::pmr::monotonic_buffer_resource batch_arena;
+    vector<SizeGroup> batch;
+    size_t batch_count = 0;
+    Progress progress(0);
+    const SizeGroupFunction verify =
+        [&](const SizeGroup &same_hash, DedupWorker &worker,
+            vector<DuplicateVector> &sets)
+        {
+            const uintmax_t size = duplicates.files.size(same_hash[0]);
+            if (trust_hash && H::trusted_prefix(size, bytes))
+            {
+                sets.emplace_back(same_hash.begin(), same_hash.end());
+                return;
+            }
+            worker.verifier.verify(same_hash.data(), same_hash.size(), size,
+                                   sets);
+        };
+    const auto verify_batch = [&]()
+    {
+        vector<const SizeGroup *> groups;
+        groups.reserve(batch.size());
+        for (const auto &group : batch)
+        {
+            groups.push_back(&group);
+        }
+        for (auto &identicals : deduplicate_groups(groups, duplicates.files,
+                                                   cl_args, progress, verify))
+        {
+            duplicates.sets.push_back(std::move(identicals));
+        }
+        batch.clear();
+        batch_arena.release();
+        batch_count = 0;
+    };
+
+    // The group that is being merged is only added to the batch when it is
+    // complete and has more than one file
+    vector<FileId> ids;
+    Candidate<T> first{0, T(), 0};
+    const auto end_group = [&]()
+    {
+        if (ids.size() > 1)
+        {
+            batch.emplace_back(ids.begin(), ids.end(), &batch_arena);
+            batch_count += ids.size();
+            if (batch_count >= batch_limit)
+            {
+                verify_batch();
+            }
+        }
+        ids.clear();
+    };
+    sorter.merge([&](const Candidate<T> &candidate)
+    {
+        if (!ids.empty() && !candidate.same_group(first))
+        {
+            end_group();
+        }
+        if (ids.empty())
+        {
+            first = candidate;
+        }
+        ids.push_back(candidate.id);
+    });
+    end_group();
+    if (!batch.empty())
+    {
+        verify_batch();
+    }
+
+    if (std::get<bool>(cl_args.at("verbose")))
+    {
+        cout << endl << "Wrote " << sorter.run_count()
+             << " sorted runs of candidates." << endl;
+    }
+    cout << endl << "Done checking." << endl;
+
+    return duplicates;
+}
+
+template Duplicates find_duplicates_external<uint8_t>(const ArgMap &cl_args);
+template Duplicates find_duplicates_external<uint16_t>(const ArgMap &cl_args);
+template Duplicates find_duplicates_external<uint32_t>(const ArgMap &cl_args);
+template Duplicates find_duplicates_external<uint64_t>(const ArgMap &cl_args);
+template Duplicates find_duplicates_external<Digest128>(
+    const ArgMap &cl_args);
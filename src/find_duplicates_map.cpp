@@ -1,9 +1,12 @@
+#include "file_reader.h"
 #include "find_duplicates_base.h"
+#include "group_table.h"
+#include "hasher.h"
 #include "utilities.h"
 
 #include <filesystem>
 #include <iostream>
-#include <unordered_map>
+#include <memory_resource>
 #include <variant>
 #include <vector>
 
@@ -17,106 +20,59 @@ namespace fs = std::filesystem;
 
 namespace {
 /**
- * Stores Files, their sizes and hashes of file contents.
- * The key of the outer map is file size.
- * The key of the inner map is the hash of the beginning N bytes of a file,
- * where N is a program argument.
- * The key type T is one of {uint8_t, uint16_t, uint32_t, uint64_t}.
- * The value of the inner map contains the paths of all files that produce the 
- * same hash. Because files can differ after the first N bytes, the outer vector
- * contains inner vectors that contain Files whose whole content is the same.
+ * Stores the ids of files of the same size, grouped by hashes of file 
+ * contents. The key of the table is the hash of the beginning N bytes of a 
+ * file, where N is a program argument.
+ * The key type T is one of {uint8_t, uint16_t, uint32_t, uint64_t, Digest128}.
+ * Each group contains the ids of all files that produce the same hash.
+ * Because files can differ after the first N bytes, the files are verified
+ * to be identical after all of them have been inserted.
  */
 template <typename T>
-using DedupTable = std::unordered_map<
-    uintmax_t,
-    std::unordered_map<
-        T,
-        vector<DuplicateVector>
-    >
->;
+using DedupTable = GroupTable<T>;
 
 /**
- * Checks the given vector of duplicate file vectors for a file that has the
- * same content as the file in the given path. If found, inserts the path
- * to the duplicate file vector and returns true.
- */ 
-bool find_duplicate_file(const File &file,
-                         vector<DuplicateVector> &vec_vec)
-{
-    // vec_vec contains Files that have the same hash
-    // dup_vec contains Files whose whole content is the same
-    for (auto &dup_vec: vec_vec)
-    {
-        try
-        {
-            if (compare_files(file.path, dup_vec[0].path))
-            {
-                // Identical to the files in dup_vec
-                dup_vec.push_back(file);
-                return true;
-            }
-        }
-        catch(const FileException &e)
-        {
-            // By catching here we can compare to the other elements of dup_vec
-            cerr << e.what() << '\n';
-        }                           
-    }
-    return false;
-}
-
-/**
- * Inserts the given File into the deduplication table.
+ * Inserts the given file into the deduplication table, hashed with the 
+ * hasher policy H.
  */
-template <typename T>
-void insert_into_dedup_table(const File &file, uintmax_t size,
-                             DedupTable<T> &dedup_table, uintmax_t bytes)
+template <typename T, typename H>
+void insert_into_dedup_table(FileId file, DedupTable<T> &dedup_table, 
+                             uintmax_t bytes, const FileCatalog &files,
+                             const PrefixHashes &prefix_hashes,
+                             FileReader &reader, string &path)
 {   
-    // Calculate the hash and truncate it to the specified length
-    const auto hash = static_cast<T>(hash_file(file.path, bytes));
-
-    // If this vector doesn't already exist, [] creates it
-    vector<DuplicateVector> &vec_vec = dedup_table[size][hash];
-
-    if (vec_vec.empty()) // First file that produces this hash
-    {
-        vec_vec.push_back(
-            vector<File>{file});
-    }
-    else
-    {
-        if (!find_duplicate_file(
-            file, vec_vec))
-        {
-            // File differs from others with the same hash
-            vec_vec.push_back(
-                vector<File>{file});
-        }
-    }
+    // Get the hash of the specified length
+    const T hash = H::prefix(file, files, prefix_hashes, bytes, reader,
+                             path);
+
+    dedup_table.insert(hash, file);
 }
 
 /**
- * Manages the deduplication. Stores progress information and inserts Files to
- * dedup_table.
+ * Manages the deduplication of a size group. Inserts files to dedup_table and
+ * advances the progress. Files are hashed with the hasher policy H.
  */
-template <typename T>
+template <typename T, typename H = Hasher<T>>
 class DedupManager {
         DedupTable<T> &dedup_table;
+        const FileCatalog &files;
+        const PrefixHashes &prefix_hashes;
+        DedupWorker &worker;
         const uintmax_t bytes;
-        size_t current_count;
-        const size_t total_count;
-        const size_t step_size;
     
     public:
-        DedupManager(DedupTable<T> &d, uintmax_t b, size_t t_c, size_t s_s)
-            : dedup_table(d), bytes(b), current_count(0), total_count(t_c), 
-              step_size( s_s == 0 ? 1 : s_s ) {}; // Prevent zero step size
+        DedupManager(DedupTable<T> &d, const FileCatalog &f, 
+                     const PrefixHashes &p, DedupWorker &w, uintmax_t b)
+            : dedup_table(d), files(f), prefix_hashes(p), worker(w), 
+              bytes(b) {};
 
-        void insert(const File &file, uintmax_t size)
+        void insert(FileId file)
         {
             try
             {
-                insert_into_dedup_table(file, size, dedup_table, bytes);
+                insert_into_dedup_table<T, H>(file, dedup_table, bytes, 
+                                              files, prefix_hashes, 
+                                              worker.reader, worker.path);
             }
             catch(const fs::filesystem_error &e)
             {
@@ -124,14 +80,13 @@ class DedupManager {
             }
             catch(const std::runtime_error &e)
             {
-                cerr << e.what() << " [" << file.path << "]\n";
+                cerr << e.what() << " [" << files.path(file) << "]\n";
             }
             catch(const std::exception& e)
             {
                 cerr << e.what() << '\n';
             }
-            ++current_count;
-            print_progress(current_count, total_count, step_size);
+            worker.progress.advance();
         }
 };
 }
@@ -142,15 +97,20 @@ class DedupManager {
  * Path can be a file or a directory.
  * Directories can be searched recursively, according to the given parameter.
  * 
- * Returns a vector whose elements are vectors of duplicate files.
+ * Returns the sets of duplicate files.
  */
-template <typename T>
-vector<DuplicateVector> find_duplicates_map(const ArgMap &cl_args)
+template <typename T, typename H>
+Duplicates find_duplicates_map(const ArgMap &cl_args)
 {    
-    FileSizeTable file_size_table;
+    // The table of the scan is released in one step
+    std::pmr::monotonic_buffer_resource scan_arena;
+    FileSizeTable file_size_table(&scan_arena);
+    Duplicates duplicates;
+    PrefixHashes prefix_hashes;
 
     // Start by scanning the paths for files
-    const size_t total_count = scan_all_paths(file_size_table, cl_args);
+    const size_t total_count = scan_all_paths(duplicates.files, 
+        file_size_table, cl_args, &prefix_hashes);
 
     // Files with unique size can't have duplicates
     const size_t no_fls_with_uniq_sz = 
@@ -158,60 +118,48 @@ vector<DuplicateVector> find_duplicates_map(const ArgMap &cl_args)
 
     const size_t total_non_unique_sz_count = total_count - no_fls_with_uniq_sz;
 
-    DedupTable<T> dedup_table;
-
-    // Both are grouped by file size
-    dedup_table.reserve(file_size_table.size());
     const uintmax_t bytes = std::get<uintmax_t>(cl_args.at("bytes"));
-
-    { // The deduplication
-        DedupManager<T> dm = DedupManager<T>(dedup_table, 
-        bytes, total_non_unique_sz_count, total_non_unique_sz_count / 20 + 1);
-
-        auto iter = file_size_table.begin();
-        auto end_iter = file_size_table.end();
-
-        for (; iter != end_iter;)
+    hash_prefixes(file_size_table, duplicates.files, cl_args, prefix_hashes);
+    const bool trust_hash = std::get<bool>(cl_args.at("trust-hash"));
+
+    // Each size group is deduplicated separately, and the vectors of files 
+    // whose whole content is the same are collected
+    duplicates.sets = deduplicate_size_groups(file_size_table, 
+        duplicates.files, cl_args, total_non_unique_sz_count,
+        [&](const SizeGroup &same_size, DedupWorker &worker,
+            vector<DuplicateVector> &sets)
         {
-            for (const auto &file : iter->second)
+            DedupTable<T> dedup_table(same_size.size(), &worker.arena);
+            DedupManager<T, H> dm = DedupManager<T, H>(dedup_table, 
+                duplicates.files, prefix_hashes, worker, bytes);
+            for (const auto file : same_size)
             {
-                dm.insert(file, iter->first);
+                dm.insert(file);
             }
-            iter = file_size_table.erase(iter);
-        }
-    }
-    
-    cout << endl << "Done checking." << endl;
 
-    // Includes vectors of files whose whole content is the same
-    vector<DuplicateVector> duplicates;
-    {
-        auto same_size_iter = dedup_table.begin();
-        auto end_iter = dedup_table.end();
-
-        for (; same_size_iter != end_iter;)
-        {
-            for (const auto &same_hash : same_size_iter->second)
+            // Files with the same trusted digest are identical without 
+            // comparing them
+            const uintmax_t size = duplicates.files.size(same_size[0]);
+            const bool trusted = trust_hash 
+                && H::trusted_prefix(size, bytes);
+            dedup_table.for_each_group([&](const FileId *ids, size_t count)
             {
-                for (const auto &identicals : same_hash.second)
+                if (trusted)
                 {
-                    if (identicals.size() > 1)
-                    {
-                        duplicates.push_back(std::move(identicals));
-                    }
+                    sets.emplace_back(ids, ids + count);
+                    return;
                 }
-            }
-            same_size_iter = dedup_table.erase(same_size_iter);
-        }
-    }
+                worker.verifier.verify(ids, count, size, sets);
+            });
+        });
+    
+    cout << endl << "Done checking." << endl;
+
     return duplicates;
 }
 
-template vector<DuplicateVector> find_duplicates_map<uint8_t>(
-    const ArgMap &cl_args);
-template vector<DuplicateVector> find_duplicates_map<uint16_t>(
-    const ArgMap &cl_args);
-template vector<DuplicateVector> find_duplicates_map<uint32_t>(
-    const ArgMap &cl_args);
-template vector<DuplicateVector> find_duplicates_map<uint64_t>(
-    const ArgMap &cl_args);
+template Duplicates find_duplicates_map<uint8_t>(const ArgMap &cl_args);
+template Duplicates find_duplicates_map<uint16_t>(const ArgMap &cl_args);
+template Duplicates find_duplicates_map<uint32_t>(const ArgMap &cl_args);
+template Duplicates find_duplicates_map<uint64_t>(const ArgMap &cl_args);
+template Duplicates find_duplicates_map<Digest128>(const ArgMap &cl_args);
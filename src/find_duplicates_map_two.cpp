@@ -1,9 +1,15 @@
+#include "file_reader.h"
 #include "find_duplicates_base.h"
+#include "fingerprint.h"
+#include "group_table.h"
+#include "hasher.h"
 #include "utilities.h"
 
+#include <algorithm>
 #include <filesystem>
 #include <iostream>
-#include <unordered_map>
+#include <memory_resource>
+#include <mutex>
 #include <variant>
 #include <vector>
 
@@ -17,171 +23,95 @@ namespace fs = std::filesystem;
 
 namespace {
 /**
- * Stores Files, their sizes and hashes of file contents.
- * The key of the outer map is file size.
- * The key of the inner map is the hash of the beginning N bytes of a file 
- * (short hash), where N is a program argument.
- * The key type T is one of {uint8_t, uint16_t, uint32_t, uint64_t}.
- * The value of the inner map contains the paths of all files that produce the 
- * same short hash.
- * When adding a File to ShortTable:
- *   if the vector is empty:
- *     add the new File to the vector
- *   if the vector already contains one File:
- *     copy the occupant to LongTable
- *     add the new File to LongTable
- *     add the new File to the vector
- *   if the vector already contains two Files:
- *     add the new File to LongTable
+ * Stores the ids of files of the same size that are still candidates for
+ * duplicates, grouped by their hashes in a stage of the deduplication.
+ * The key type T is one of {uint8_t, uint16_t, uint32_t, uint64_t, 
+ * Digest128}.
+ * Each group contains the ids of files that produce the same hash. Files
+ * that are alone in their group can't have duplicates, so only the other
+ * groups are passed to the next stage.
  */
 template <typename T>
-using ShortTable = std::unordered_map<
-    uintmax_t,
-    std::unordered_map<
-        T,
-        vector<File>
-    >
->;
+using StageTable = GroupTable<T>;
 
 /**
- * If at least two Files have the same short hash, this table is used to store 
- * their long hashes. The long hash is calculated from the whole file. 
- * The value of the map contains the paths of all files that produce the 
- * same long hash. Because hashes can collide, the outer vector
- * contains inner vectors that contain Files whose whole content is the same.
+ * Counts the files that were found to have no duplicates in each stage, and
+ * in the final comparison. Groups are added from several threads.
  */
-template <typename T>
-using LongTable = std::unordered_map<
-    T,
-    vector<DuplicateVector>
->;
+class EliminationCounts {
+        const vector<FingerprintStage> &stages;
+        std::mutex mutex;
+        vector<size_t> counts;
 
-/**
- * Checks the given vector of duplicate file vectors for a file that has the
- * same content as the file in the given path. If found, inserts the path
- * to the duplicate file vector and returns true.
- */ 
-bool find_duplicate_file(const File &file,
-                         vector<DuplicateVector> &vec_vec)
-{
-    // vec_vec contains Files that have the same hash
-    // dup_vec contains Files whose whole content is the same
-    for (auto &dup_vec: vec_vec)
-    {
-        try
+    public:
+        explicit EliminationCounts(const vector<FingerprintStage> &s)
+            : stages(s), counts(s.size() + 1, 0) {};
+
+        void add(const std::pmr::vector<size_t> &group_counts)
         {
-            if (compare_files(file.path, dup_vec[0].path))
+            std::lock_guard<std::mutex> lock(mutex);
+            for (size_t i = 0; i < counts.size(); ++i)
             {
-                // Identical to the files in dup_vec
-                dup_vec.push_back(file);
-                return true;
+                counts[i] += group_counts[i];
             }
         }
-        catch(const FileException &e)
-        {
-            // By catching here we can compare to the other elements of 
-            // dup_vec
-            cerr << e.what() << '\n';
-        }                           
-    }
-    return false;
-}
-
-/**
- * Inserts the given File into the deduplication tables.
- */
-template <typename T>
-void insert_into_dedup_table(const File &file, uintmax_t size,
-                             ShortTable <T> &short_table, uintmax_t bytes, 
-                             LongTable<T> &long_table)
-{   
-    // Calculate the hash and truncate it to the specified length
-    const auto hash = static_cast<T>(hash_file(file.path, bytes));
 
-    // If this vector doesn't already exist, [] creates it
-    vector<File> &vec = short_table[size][hash];
-
-    if (vec.empty()) // First file that produces this hash
-    {
-        // Add the file only to short table 
-        vec.push_back(file);
-    }
-    else
-    {
-        if (vec.size() == 1) // Short table slot already occupied, 
-                             // copy the occupant to long table
+        void print()
         {
-            const auto long_hash_existing = 
-                static_cast<T>(hash_file(vec[0].path, 0));
-            vector<DuplicateVector> &vec_vec_ex = 
-                long_table[long_hash_existing];
-
-            if (vec_vec_ex.empty())
+            cout << "Files eliminated by stage:";
+            for (size_t i = 0; i < stages.size(); ++i)
             {
-                vec_vec_ex.push_back(
-                    vector<File>{vec[0]});
+                cout << ' ' << stage_name(stages[i]) << ' ' << counts[i]
+                     << ',';
             }
-            else if (!find_duplicate_file(
-                vec[0], vec_vec_ex))
-            {
-                // File differs from others with the same hash
-                vec_vec_ex.push_back(
-                    vector<File>{vec[0]});
-            }
-        }
-
-        // Add the file to long table 
-        const auto long_hash = static_cast<T>(hash_file(file.path, 0));
-        vector<DuplicateVector> &vec_vec = long_table[long_hash];
-
-        if (vec_vec.empty())
-        {
-            vec_vec.push_back(
-                vector<File>{file});
+            cout << " compare " << counts.back() << '.' << endl;
         }
-        else if (!find_duplicate_file(
-            file, vec_vec))
-        {
-            // File differs from others with the same hash
-            vec_vec.push_back(
-                vector<File>{file});
-        }
-
-        // Add the file to short table to signal that the long table must be
-        // used
-        if (vec.size() < 2)
-        {
-            vec.push_back(file);
-        }
-    }
-}
+};
 
 /**
- * Manages the deduplication. Stores progress information and inserts Files to
- * the dedup tables.
+ * Manages the deduplication of a size group. Inserts files to the dedup tables
+ * and advances the progress of the files that are left out. Files are hashed
+ * with the hasher policy H.
  */
-template <typename T>
+template <typename T, typename H = Hasher<T>>
 class DedupManager {
-        ShortTable <T> &short_table;
+        const FileCatalog &files;
+        const PrefixHashes &prefix_hashes;
+        DedupWorker &worker;
         const uintmax_t bytes;
-        size_t current_count;
-        const size_t total_count;
-        const size_t step_size;
-        LongTable<T> &long_table;
-    
+
     public:
-        DedupManager(ShortTable <T> &d, uintmax_t b, size_t t_c, size_t s_s, 
-                     LongTable<T> &l)
-            : short_table(d), bytes(b), current_count(0), total_count(t_c), 
-              step_size( s_s == 0 ? 1 : s_s ),
-              long_table(l) {}; // Prevent zero step size
+        DedupManager(const FileCatalog &f, const PrefixHashes &p,
+                     DedupWorker &w, uintmax_t b)
+            : files(f), prefix_hashes(p), worker(w), bytes(b) {};
 
-        void insert(const File &file, uintmax_t size)
+        /**
+         * Inserts the given file into the given table by its hash in the
+         * given stage.
+         */
+        void insert(FileId file, FingerprintStage stage, StageTable<T> &table)
         {
             try
             {
-                insert_into_dedup_table(file, size, short_table, bytes, 
-                                        long_table);
+                // Get the hash of the specified length
+                T hash;
+                if (stage == FingerprintStage::prefix)
+                {
+                    hash = H::prefix(file, files, prefix_hashes, bytes, 
+                                     worker.reader, worker.path);
+                }
+                else if (stage == FingerprintStage::full)
+                {
+                    hash = H::whole(file, files, worker.reader,
+                                    worker.path);
+                }
+                else
+                {
+                    hash = H::part(fingerprint(stage, file, files, 
+                        prefix_hashes, bytes, worker.reader, worker.path));
+                }
+                table.insert(hash, file);
+                return;
             }
             catch(const fs::filesystem_error &e)
             {
@@ -189,14 +119,24 @@ class DedupManager {
             }
             catch(const std::runtime_error &e)
             {
-                cerr << e.what() << " [" << file.path << "]\n";
+                cerr << e.what() << " [" << files.path(file) << "]\n";
             }
             catch(const std::exception& e)
             {
                 cerr << e.what() << '\n';
             }
-            ++current_count;
-            print_progress(current_count, total_count, step_size);
+            worker.progress.advance();
+        }
+
+        /**
+         * Counts the given files as checked.
+         */
+        void skip(size_t count)
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                worker.progress.advance();
+            }
         }
 };
 }
@@ -207,15 +147,20 @@ class DedupManager {
  * Path can be a file or a directory.
  * Directories can be searched recursively, according to the given parameter.
  * 
- * Returns a vector whose elements are vectors of duplicate files.
+ * Returns the sets of duplicate files.
  */
-template <typename T>
-vector<DuplicateVector> find_duplicates_map_two(const ArgMap &cl_args)
+template <typename T, typename H>
+Duplicates find_duplicates_map_two(const ArgMap &cl_args)
 {    
-    FileSizeTable file_size_table;
+    // The table of the scan is released in one step
+    std::pmr::monotonic_buffer_resource scan_arena;
+    FileSizeTable file_size_table(&scan_arena);
+    Duplicates duplicates;
+    PrefixHashes prefix_hashes;
 
     // Start by scanning the paths for files
-    const size_t total_count = scan_all_paths(file_size_table, cl_args);
+    const size_t total_count = scan_all_paths(duplicates.files, 
+        file_size_table, cl_args, &prefix_hashes);
 
     // Files with unique size can't have duplicates
     const size_t no_fls_with_uniq_sz = 
@@ -223,59 +168,118 @@ vector<DuplicateVector> find_duplicates_map_two(const ArgMap &cl_args)
 
     const size_t total_non_unique_sz_count = total_count - no_fls_with_uniq_sz;
 
-    ShortTable<T> short_table;
-    LongTable<T> long_table;
-
-    // Both are grouped by file size
-    short_table.reserve(file_size_table.size());
     const uintmax_t bytes = std::get<uintmax_t>(cl_args.at("bytes"));
+    hash_prefixes(file_size_table, duplicates.files, cl_args, prefix_hashes);
+    const bool trust_hash = std::get<bool>(cl_args.at("trust-hash"));
 
-    { // The deduplication
-        DedupManager<T> dm = DedupManager<T>(short_table, bytes, 
-        total_non_unique_sz_count, total_non_unique_sz_count / 20 + 1,
-        long_table);
-
-        auto iter = file_size_table.begin();
-        auto end_iter = file_size_table.end();
+    vector<FingerprintStage> stages;
+    for (const auto &name :
+         std::get<vector<string>>(cl_args.at("stages")))
+    {
+        stages.push_back(stage_from_name(name));
+    }
+    EliminationCounts eliminated(stages);
 
-        for (; iter != end_iter;)
+    // Each size group is narrowed down stage by stage, and the vectors of
+    // files whose whole content is the same are collected
+    duplicates.sets = deduplicate_size_groups(file_size_table,
+        duplicates.files, cl_args, total_non_unique_sz_count,
+        [&](const SizeGroup &same_size, DedupWorker &worker,
+            vector<DuplicateVector> &sets)
         {
-            for (const auto &file : iter->second)
+            DedupManager<T, H> dm = DedupManager<T, H>(duplicates.files,
+                prefix_hashes, worker, bytes);
+            const uintmax_t size = duplicates.files.size(same_size[0]);
+            std::pmr::vector<size_t> counts(stages.size() + 1, 0,
+                                            &worker.arena);
+
+            // Groups that are still candidates, as the offsets and numbers
+            // of their ids
+            std::pmr::vector<FileId> ids(same_size.begin(), same_size.end(),
+                                         &worker.arena);
+            std::pmr::vector<std::pair<size_t, size_t>> candidates(
+                {{0, ids.size()}}, &worker.arena);
+            // Length of the beginning that is known to be the same, and 
+            // whether the files have the same trusted digests
+            uintmax_t covered = 0;
+            bool trusted = false;
+            for (size_t i = 0; i < stages.size(); ++i)
             {
-                dm.insert(file, iter->first);
-            }
-            iter = file_size_table.erase(iter);
-        }
-    }
-    
-    cout << endl << "Done checking." << endl;
+                if (!stage_applies(stages[i], size, bytes, covered))
+                {
+                    continue;
+                }
+                covered = std::max(covered,
+                                   stage_coverage(stages[i], size, bytes));
+                trusted = trusted || (stages[i] == FingerprintStage::full 
+                                      && H::trustworthy)
+                    || (stages[i] == FingerprintStage::prefix 
+                        && H::trusted_prefix(size, bytes));
 
-    // Includes vectors of files whose whole content is the same
-    vector<DuplicateVector> duplicates;
-    {
-        auto same_hash_iter = long_table.begin();
-        auto end_iter = long_table.end();
+                std::pmr::vector<FileId> next_ids(&worker.arena);
+                std::pmr::vector<std::pair<size_t, size_t>> next_candidates(
+                    &worker.arena);
+                for (const auto &group : candidates)
+                {
+                    StageTable<T> table(group.second, &worker.arena);
+                    for (size_t j = group.first; 
+                         j < group.first + group.second; ++j)
+                    {
+                        dm.insert(ids[j], stages[i], table);
+                    }
+                    const size_t single_count = table.for_each_group(
+                        [&](const FileId *same_hash, size_t count)
+                        {
+                            next_candidates.emplace_back(next_ids.size(), 
+                                                         count);
+                            next_ids.insert(next_ids.end(), same_hash, 
+                                            same_hash + count);
+                        });
+                    counts[i] += single_count;
+                    dm.skip(single_count);
+                }
+                ids.swap(next_ids);
+                candidates.swap(next_candidates);
+            }
 
-        for (; same_hash_iter != end_iter;)
-        {
-            for (const auto &identicals : same_hash_iter->second)
+            // Compare the whole content of files that have the same hashes,
+            // unless the hashes are trusted
+            for (const auto &group : candidates)
             {
-                if (identicals.size() > 1)
+                const FileId *first = ids.data() + group.first;
+                const size_t group_size = group.second;
+                if (trust_hash && trusted)
                 {
-                    duplicates.push_back(std::move(identicals));
+                    dm.skip(group_size);
+                    sets.emplace_back(first, first + group_size);
+                    continue;
                 }
+                const size_t set_count = sets.size();
+                worker.verifier.verify(first, group_size, size, sets);
+                size_t identical_count = 0;
+                for (size_t j = set_count; j < sets.size(); ++j)
+                {
+                    identical_count += sets[j].size();
+                }
+                counts.back() += group_size - identical_count;
+                dm.skip(group_size);
             }
-            same_hash_iter = long_table.erase(same_hash_iter);
-        }
-    }
+            eliminated.add(counts);
+        });
+
+    cout << endl << "Done checking." << endl;
+    eliminated.print();
+
     return duplicates;
 }
 
-template vector<DuplicateVector> find_duplicates_map_two<uint8_t>(
+template Duplicates find_duplicates_map_two<uint8_t>(
+    const ArgMap &cl_args);
+template Duplicates find_duplicates_map_two<uint16_t>(
     const ArgMap &cl_args);
-template vector<DuplicateVector> find_duplicates_map_two<uint16_t>(
+template Duplicates find_duplicates_map_two<uint32_t>(
     const ArgMap &cl_args);
-template vector<DuplicateVector> find_duplicates_map_two<uint32_t>(
+template Duplicates find_duplicates_map_two<uint64_t>(
     const ArgMap &cl_args);
-template vector<DuplicateVector> find_duplicates_map_two<uint64_t>(
+template Duplicates find_duplicates_map_two<Digest128>(
     const ArgMap &cl_args);
@@ -1,11 +1,13 @@
+#include "file_reader.h"
 #include "find_duplicates_base.h"
+#include "hasher.h"
+#include "radix_sort.h"
 #include "utilities.h"
 
-#include <algorithm>
 #include <csignal>
 #include <filesystem>
 #include <iostream>
-#include <unordered_map>
+#include <memory_resource>
 #include <variant>
 #include <vector>
 
@@ -19,74 +21,60 @@ namespace fs = std::filesystem;
 
 namespace {
 /**
- * Stores Files and hashes of the beginnings of their data.
+ * Stores file ids and hashes of the beginnings of their data. The files of
+ * a vector all have the same size, so the hash alone tells which files may
+ * be identical.
  */
 template <typename T>
-using DedupVector = std::vector<
+using DedupVector = std::pmr::vector<
                         std::pair<
                             T, 
-                            File
+                            FileId
                         >
                     >;
 
 /**
- * Checks the given vector for files identical to the one in the given path and 
- * returns them.
+ * Inserts the given file into the deduplication vector, hashed with the 
+ * hasher policy H.
  */
-template <typename T>
-DuplicateVector find_duplicate_file(string path, 
-                                    vector<std::pair<T, File>> &same_hashes)
-{
-    DuplicateVector dup_vec;
-    for (auto curr = same_hashes.begin(); curr != same_hashes.end();)
-    {
-        if (compare_files(path, curr->second.path))
-        {
-            dup_vec.push_back(curr->second);
-            curr = same_hashes.erase(curr);
-        }
-        else
-        {
-            ++curr;
-        }
-    }
-    return dup_vec;
-}
-
-/**
- * Inserts the given File into the deduplication vector.
- */
-template <typename T>
-void insert_into_dedup_vector(const File &file, 
-                             DedupVector<T> &dedup_vector, uintmax_t bytes)
+template <typename T, typename H>
+void insert_into_dedup_vector(FileId file, 
+                             DedupVector<T> &dedup_vector, uintmax_t bytes,
+                             const FileCatalog &files,
+                             const PrefixHashes &prefix_hashes,
+                             FileReader &reader, string &path)
 {   
-    // Calculate the hash and truncate it to the specified length
-    const auto hash = static_cast<T>(hash_file(file.path, bytes));
+    // Get the hash of the specified length
+    const T hash = H::prefix(file, files, prefix_hashes, bytes, reader,
+                             path);
     dedup_vector.push_back(std::make_pair(hash, file));
 }
 
 /**
- * Manages the deduplication. Stores progress information and inserts Files to
- * dedup_table.
+ * Manages the deduplication of a size group. Inserts files to dedup_vector and
+ * advances the progress. Files are hashed with the hasher policy H.
  */
-template <typename T>
+template <typename T, typename H = Hasher<T>>
 class DedupManager {
         DedupVector<T> &dedup_vector;
+        const FileCatalog &files;
+        const PrefixHashes &prefix_hashes;
+        DedupWorker &worker;
         const uintmax_t bytes;
-        size_t current_count;
-        const size_t total_count;
-        const size_t step_size;
     
     public:
-        DedupManager(DedupVector<T> &d, uintmax_t b, size_t t_c, size_t s_s)
-            : dedup_vector(d), bytes(b), current_count(0), total_count(t_c), 
-              step_size( s_s == 0 ? 1 : s_s ) {}; // Prevent zero step size
+        DedupManager(DedupVector<T> &d, const FileCatalog &f, 
+                     const PrefixHashes &p, DedupWorker &w, uintmax_t b)
+            : dedup_vector(d), files(f), prefix_hashes(p), worker(w), 
+              bytes(b) {};
 
-        void insert(const File &file)
+        void insert(FileId file)
         {
             try
             {
-                insert_into_dedup_vector(file, dedup_vector, bytes);
+                insert_into_dedup_vector<T, H>(file, dedup_vector, bytes, 
+                                               files, prefix_hashes, 
+                                               worker.reader, worker.path);
             }
             catch(const fs::filesystem_error &e)
             {
@@ -94,26 +82,15 @@ class DedupManager {
             }
             catch(const std::runtime_error &e)
             {
-                cerr << e.what() << " [" << file.path << "]\n";
+                cerr << e.what() << " [" << files.path(file) << "]\n";
             }
             catch(const std::exception& e)
             {
                 cerr << e.what() << '\n';
             }
-            ++current_count;
-            print_progress(current_count, total_count, step_size);
+            worker.progress.advance();
         }
 };
-
-/**
- * Sort by the hashes of files.
- */
-template <typename T>
-bool sort_only_by_first(const std::pair<T, File> &a, 
-                        const std::pair<T, File> &b) 
-{ 
-    return (a.first < b.first); 
-} 
 }
 
 /**
@@ -122,15 +99,20 @@ bool sort_only_by_first(const std::pair<T, File> &a,
  * Path can be a file or a directory.
  * Directories can be searched recursively, according to the given parameter.
  * 
- * Returns a vector whose elements are vectors of duplicate files.
+ * Returns the sets of duplicate files.
  */
-template <typename T>
-vector<DuplicateVector> find_duplicates_vector(const ArgMap &cl_args)
+template <typename T, typename H>
+Duplicates find_duplicates_vector(const ArgMap &cl_args)
 {    
-    FileSizeTable file_size_table;
+    // The table of the scan is released in one step
+    std::pmr::monotonic_buffer_resource scan_arena;
+    FileSizeTable file_size_table(&scan_arena);
+    Duplicates duplicates;
+    PrefixHashes prefix_hashes;
 
     // Start by scanning the paths for files
-    const size_t total_count = scan_all_paths(file_size_table, cl_args);
+    const size_t total_count = scan_all_paths(duplicates.files, 
+        file_size_table, cl_args, &prefix_hashes);
 
     // Files with unique size can't have duplicates
     const size_t no_fls_with_uniq_sz = 
@@ -139,80 +121,74 @@ vector<DuplicateVector> find_duplicates_vector(const ArgMap &cl_args)
     const size_t total_non_unique_sz_count = total_count - no_fls_with_uniq_sz;
 
     const uintmax_t bytes = std::get<uintmax_t>(cl_args.at("bytes"));
-
-    DedupVector<T> dedup_vector;
-    dedup_vector.reserve(total_non_unique_sz_count);
-
-    { // Collect all files in the deduplication vector and sort them according 
-      // to the hash of the beginning of their data.
-        DedupManager<T> dm = DedupManager<T>(dedup_vector, 
-        bytes, total_non_unique_sz_count, total_non_unique_sz_count / 20 + 1);
-
-        auto iter = file_size_table.begin();
-        auto end_iter = file_size_table.end();
-
-        for (; iter != end_iter;)
+    hash_prefixes(file_size_table, duplicates.files, cl_args, prefix_hashes);
+    const bool trust_hash = std::get<bool>(cl_args.at("trust-hash"));
+    const unsigned threads = thread_count(cl_args);
+
+    // Each size group is deduplicated separately, and the vectors of files 
+    // whose whole content is the same are collected
+    duplicates.sets = deduplicate_size_groups(file_size_table, 
+        duplicates.files, cl_args, total_non_unique_sz_count,
+        [&](const SizeGroup &same_size, DedupWorker &worker,
+            vector<DuplicateVector> &sets)
         {
-            for (const auto &file : iter->second)
+            // Collect the files in the deduplication vector and sort them 
+            // according to the hash of the beginning of their data
+            DedupVector<T> dedup_vector(&worker.arena);
+            dedup_vector.reserve(same_size.size());
+            DedupManager<T, H> dm = DedupManager<T, H>(dedup_vector, 
+                duplicates.files, prefix_hashes, worker, bytes);
+            for (const auto file : same_size)
             {
                 dm.insert(file);
             }
-            iter = file_size_table.erase(iter);
-        }
-
-        std::sort(dedup_vector.begin(), dedup_vector.end(), 
-            sort_only_by_first<T>);
-    }
-
-    cout << endl << "Done checking." << endl;
+            // Workers that ran out of groups help with the sort, so the
+            // threads of the pool aren't multiplied
+            {
+                const SpareThreads helpers(worker.spare_threads, threads - 1);
+                radix_sort(dedup_vector, 1 + helpers.size());
+            }
 
-    // Includes vectors of files whose whole content is the same
-    vector<DuplicateVector> duplicates;
-    if (dedup_vector.size() == 0) {
-        return duplicates;
-    }
-    {
-        // Group files that have the same hash into vectors
-        vector<DedupVector<T>> vec_of_same_hashes;
-        for (size_t i = 0; i < dedup_vector.size() - 1; i++)
-        {
-            DedupVector<T> same_hashes;
-            same_hashes.push_back(dedup_vector[i]);
-            size_t j = 0;
-            for (; i+j+1 < dedup_vector.size() && 
-                same_hashes.back().first == dedup_vector[i+j+1].first; j++)
+            // The files with the same hash are now ranges of the sorted ids
+            std::pmr::vector<FileId> ids(&worker.arena);
+            ids.reserve(dedup_vector.size());
+            for (const auto &entry : dedup_vector)
             {
-                same_hashes.push_back(std::move(dedup_vector[i+j+1]));
+                ids.push_back(entry.second);
             }
-            i += j;
-            vec_of_same_hashes.push_back(same_hashes);
-        }
 
-        // Compare the whole content of files that have the same hash
-        for (DedupVector<T> &same_hashes: vec_of_same_hashes)
-        {
-            while (same_hashes.size() > 1)
+            // Compare the whole content of files that have the same hash,
+            // unless the hash is trusted
+            const uintmax_t size = duplicates.files.size(same_size[0]);
+            const bool trusted = trust_hash 
+                && H::trusted_prefix(size, bytes);
+            for (size_t i = 0; i < dedup_vector.size();)
             {
-                const auto to_be_compared = same_hashes.begin()->second;
-                same_hashes.erase(same_hashes.begin());
-                auto identicals = find_duplicate_file(
-                    to_be_compared.path, same_hashes);
-                if (identicals.size() > 0)
+                size_t j = i + 1;
+                while (j < dedup_vector.size() 
+                       && dedup_vector[j].first == dedup_vector[i].first)
+                {
+                    ++j;
+                }
+                if (j - i > 1 && trusted)
+                {
+                    sets.emplace_back(ids.begin() + i, ids.begin() + j);
+                }
+                else if (j - i > 1)
                 {
-                    identicals.push_back(to_be_compared);
-                    duplicates.push_back(std::move(identicals));
+                    worker.verifier.verify(&ids[i], j - i, size, sets);
                 }
+                i = j;
             }
-        }
-    }
+        });
+
+    cout << endl << "Done checking." << endl;
+
     return duplicates;
 }
 
-template vector<DuplicateVector> find_duplicates_vector<uint8_t>(
-    const ArgMap &cl_args);
-template vector<DuplicateVector> find_duplicates_vector<uint16_t>(
-    const ArgMap &cl_args);
-template vector<DuplicateVector> find_duplicates_vector<uint32_t>(
-    const ArgMap &cl_args);
-template vector<DuplicateVector> find_duplicates_vector<uint64_t>(
-    const ArgMap &cl_args);
+template Duplicates find_duplicates_vector<uint8_t>(const ArgMap &cl_args);
+template Duplicates find_duplicates_vector<uint16_t>(const ArgMap &cl_args);
+template Duplicates find_duplicates_vector<uint32_t>(const ArgMap &cl_args);
+template Duplicates find_duplicates_vector<uint64_t>(const ArgMap &cl_args);
+template Duplicates find_duplicates_vector<Digest128>(const ArgMap &cl_args);
@@ -1,11 +1,14 @@
+#include "file_reader.h"
 #include "find_duplicates_base.h"
+#include "memory_compare.h"
+#include "prefix_arena.h"
 #include "utilities.h"
 
 #include <algorithm>
 #include <csignal>
 #include <filesystem>
 #include <iostream>
-#include <unordered_map>
+#include <memory_resource>
 #include <variant>
 #include <vector>
 
@@ -19,68 +22,28 @@ namespace fs = std::filesystem;
 
 namespace {
 /**
- * Stores Files and the beginnings of their data.
- */
-using DedupVector = std::vector<
-                        std::pair<
-                            BeginningData,
-                            File
-                        >
-                    >;
-
-/**
- * Checks the given vector for files identical to the one in the given path and 
- * returns them.
- */
-DuplicateVector find_duplicate_file(string path, DedupVector &same_beginning)
-{
-    DuplicateVector dup_vec;
-    for (auto curr = same_beginning.begin(); curr != same_beginning.end();)
-    {
-        if (compare_files(path, curr->second.path))
-        {
-            dup_vec.push_back(curr->second);
-            curr = same_beginning.erase(curr);
-        }
-        else
-        {
-            ++curr;
-        }
-    }
-    return dup_vec;
-}
-
-/**
- * Inserts the given File into the deduplication vector.
- */
-void insert_into_dedup_vector(const File &file, 
-                             DedupVector &dedup_vector, uintmax_t bytes)
-{   
-    const BeginningData beginning = read_file_beginning(file.path, bytes);
-    dedup_vector.push_back(std::make_pair(beginning, file));
-}
-
-/**
- * Manages the deduplication. Stores progress information and inserts Files to
- * dedup_table.
+ * Reads the beginnings of the files of a size group into the slots of an
+ * arena, in the order in which they are inserted, and advances the progress.
+ * Files that can't be read are reported and left out.
  */
 class DedupManager {
-        DedupVector &dedup_vector;
-        const uintmax_t bytes;
-        size_t current_count;
-        const size_t total_count;
-        const size_t step_size;
+        PrefixArena &arena;
+        std::pmr::vector<FileId> &ids;
+        const FileCatalog &files;
+        DedupWorker &worker;
     
     public:
-        DedupManager(DedupVector &d, uintmax_t b, size_t t_c, size_t s_s)
-            : dedup_vector(d), bytes(b), current_count(0), total_count(t_c), 
-              step_size( s_s == 0 ? 1 : s_s ) {}; // Prevent zero step size
+        DedupManager(PrefixArena &a, std::pmr::vector<FileId> &i, 
+                     const FileCatalog &f, DedupWorker &w)
+            : arena(a), ids(i), files(f), worker(w) {};
 
-        void insert(const File &file)
+        void insert(FileId file)
         {
             try
             {
-                insert_into_dedup_vector(file, dedup_vector, bytes);
+                worker.reader.read_beginning(files.path(file, worker.path),
+                    arena.slot(ids.size()), arena.slot_width());
+                ids.push_back(file);
             }
             catch(const fs::filesystem_error &e)
             {
@@ -88,25 +51,15 @@ class DedupManager {
             }
             catch(const std::runtime_error &e)
             {
-                cerr << e.what() << " [" << file.path << "]\n";
+                cerr << e.what() << " [" << files.path(file) << "]\n";
             }
             catch(const std::exception& e)
             {
                 cerr << e.what() << '\n';
             }
-            ++current_count;
-            print_progress(current_count, total_count, step_size);
+            worker.progress.advance();
         }
 };
-
-/**
- * Sort by the beginnings of files.
- */
-bool sort_only_by_first(const std::pair<BeginningData, File> &a, 
-                        const std::pair<BeginningData, File> &b) 
-{ 
-    return (a.first < b.first);
-} 
 }
 
 /**
@@ -115,14 +68,18 @@ bool sort_only_by_first(const std::pair<BeginningData, File> &a,
  * Path can be a file or a directory.
  * Directories can be searched recursively, according to the given parameter.
  * 
- * Returns a vector whose elements are vectors of duplicate files.
+ * Returns the sets of duplicate files.
  */
-vector<DuplicateVector> find_duplicates_vector_no_hash(const ArgMap &cl_args)
+Duplicates find_duplicates_vector_no_hash(const ArgMap &cl_args)
 {    
-    FileSizeTable file_size_table;
+    // The table of the scan is released in one step
+    std::pmr::monotonic_buffer_resource scan_arena;
+    FileSizeTable file_size_table(&scan_arena);
+    Duplicates duplicates;
 
     // Start by scanning the paths for files
-    const size_t total_count = scan_all_paths(file_size_table, cl_args);
+    const size_t total_count = 
+        scan_all_paths(duplicates.files, file_size_table, cl_args);
 
     // Files with unique size can't have duplicates
     const size_t no_fls_with_uniq_sz = 
@@ -131,71 +88,62 @@ vector<DuplicateVector> find_duplicates_vector_no_hash(const ArgMap &cl_args)
     const size_t total_non_unique_sz_count = total_count - no_fls_with_uniq_sz;
 
     const uintmax_t bytes = std::get<uintmax_t>(cl_args.at("bytes"));
-
-    DedupVector dedup_vector;
-    dedup_vector.reserve(total_non_unique_sz_count);
-
-    { // Collect all files in the deduplication vector and sort them according 
-      // to the beginning of their data.
-        DedupManager dm = DedupManager(dedup_vector, 
-        bytes, total_non_unique_sz_count, total_non_unique_sz_count / 20 + 1);
-
-        auto iter = file_size_table.begin();
-        auto end_iter = file_size_table.end();
-
-        for (; iter != end_iter;)
+    // The threads share the memory limit
+    const uintmax_t memory_limit = 
+        std::get<uintmax_t>(cl_args.at("memory-limit"));
+    const uintmax_t group_memory_limit = thread_share(memory_limit, cl_args);
+
+    // Each size group is deduplicated separately, and the vectors of files 
+    // whose whole content is the same are collected
+    duplicates.sets = deduplicate_size_groups(file_size_table, 
+        duplicates.files, cl_args, total_non_unique_sz_count,
+        [&](const SizeGroup &same_size, DedupWorker &worker,
+            vector<DuplicateVector> &sets)
         {
-            for (const auto &file : iter->second)
+            // The beginnings of the files are read into an arena, and the 
+            // files are sorted according to them. Beyond the end of the 
+            // files the beginnings would be zeros.
+            const uintmax_t size = duplicates.files.size(same_size[0]);
+            PrefixArena arena(static_cast<size_t>(std::min(bytes, size)),
+                              same_size.size(), group_memory_limit,
+                              &worker.arena);
+            std::pmr::vector<FileId> ids(&worker.arena);
+            ids.reserve(same_size.size());
+            DedupManager dm = DedupManager(arena, ids, duplicates.files, 
+                                           worker);
+            for (const auto file : same_size)
             {
                 dm.insert(file);
             }
-            iter = file_size_table.erase(iter);
-        }
-
-        std::sort(dedup_vector.begin(), dedup_vector.end(), 
-            sort_only_by_first);
-    }
-
-    cout << endl << "Done checking." << endl;
-
-    // Includes vectors of files whose whole content is the same
-    vector<DuplicateVector> duplicates;
-    if (dedup_vector.size() == 0) {
-        return duplicates;
-    }
-    {
-        // Group files that have the same beginning into vectors
-        vector<DedupVector> vec_of_same_beginnings;
-        for (size_t i = 0; i < dedup_vector.size() - 1; i++)
-        {
-            DedupVector same_beginnings;
-            same_beginnings.push_back(std::move(dedup_vector[i]));
-            size_t j = 0;
-            for (; i+j+1 < dedup_vector.size() && 
-                same_beginnings.back().first == dedup_vector[i+j+1].first; j++)
+            const std::pmr::vector<FileId> order = arena.order(ids.size());
+            std::pmr::vector<FileId> sorted_ids(&worker.arena);
+            sorted_ids.reserve(order.size());
+            for (const auto index : order)
             {
-                same_beginnings.push_back(std::move(dedup_vector[i+j+1]));
+                sorted_ids.push_back(ids[index]);
             }
-            i += j;
-            vec_of_same_beginnings.push_back(same_beginnings);
-        }
 
-        // Compare the whole content of files that have the same beginning
-        for (DedupVector &same_beginnings: vec_of_same_beginnings)
-        {
-            while (same_beginnings.size() > 1)
+            // Compare the whole content of files that have the same beginning
+            for (size_t i = 0; i < order.size();)
             {
-                const auto to_be_compared = same_beginnings.begin()->second;
-                same_beginnings.erase(same_beginnings.begin());
-                auto identicals = find_duplicate_file(
-                    to_be_compared.path, same_beginnings);
-                if (identicals.size() > 0)
+                size_t j = i + 1;
+                while (j < order.size()
+                       && memory_equal(arena.slot(order[i]), 
+                                       arena.slot(order[j]), 
+                                       arena.slot_width()))
+                {
+                    ++j;
+                }
+                if (j - i > 1)
                 {
-                    identicals.push_back(to_be_compared);
-                    duplicates.push_back(std::move(identicals));
+                    worker.verifier.verify(&sorted_ids[i], j - i, size,
+                                           sets);
                 }
+                i = j;
             }
-        }
-    }
+        });
+
+    cout << endl << "Done checking." << endl;
+
     return duplicates;
 }
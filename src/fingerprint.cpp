@@ -0,0 +1,119 @@
+#include "fingerprint.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using std::size_t;
+using std::string;
+
+namespace {
+constexpr size_t block_size = 4096;
+constexpr uintmax_t sample_count = 8;
+constexpr uintmax_t min_head = 64 << 10;
+constexpr uintmax_t max_head = 16 << 20;
+
+struct StageName {
+    FingerprintStage stage;
+    const char *name;
+};
+
+constexpr StageName stage_names[] = {
+    {FingerprintStage::prefix, "prefix"},
+    {FingerprintStage::head, "head"},
+    {FingerprintStage::tail, "tail"},
+    {FingerprintStage::samples, "samples"},
+    {FingerprintStage::full, "full"}
+};
+
+uintmax_t head_length(uintmax_t size)
+{
+    return std::min(size, std::clamp(size / 16, min_head, max_head));
+}
+}
+
+FingerprintStage stage_from_name(const string &name)
+{
+    for (const auto &stage_name : stage_names)
+    {
+        if (name == stage_name.name)
+        {
+            return stage_name.stage;
+        }
+    }
+    throw std::invalid_argument("unknown stage '" + name + "'");
+}
+
+const char *stage_name(FingerprintStage stage)
+{
+    for (const auto &stage_name : stage_names)
+    {
+        if (stage == stage_name.stage)
+        {
+            return stage_name.name;
+        }
+    }
+    return "";
+}
+
+uintmax_t stage_coverage(FingerprintStage stage, uintmax_t size,
+                         uintmax_t bytes)
+{
+    switch (stage)
+    {
+    case FingerprintStage::prefix:
+        return bytes == 0 ? size : std::min(bytes, size);
+    case FingerprintStage::head:
+        return head_length(size);
+    case FingerprintStage::full:
+        return size;
+    default:
+        return 0;
+    }
+}
+
+bool stage_applies(FingerprintStage stage, uintmax_t size, uintmax_t bytes,
+                   uintmax_t covered)
+{
+    if (covered >= size)
+    {
+        return false;
+    }
+    // A beginning adds nothing unless it is longer than the known one
+    return stage == FingerprintStage::tail
+        || stage == FingerprintStage::samples
+        || stage_coverage(stage, size, bytes) > covered;
+}
+
+uint64_t fingerprint(FingerprintStage stage, FileId id,
+                     const FileCatalog &files,
+                     const PrefixHashes &prefix_hashes, uintmax_t bytes,
+                     FileReader &reader, string &path)
+{
+    const uintmax_t size = files.size(id);
+    if (stage == FingerprintStage::prefix)
+    {
+        return prefix_hashes.get(id, files, bytes, reader, path);
+    }
+    files.path(id, path);
+    switch (stage)
+    {
+    case FingerprintStage::head:
+        return reader.hash(path, head_length(size));
+    case FingerprintStage::tail:
+    {
+        const uintmax_t offset = size - std::min<uintmax_t>(size, block_size);
+        return reader.hash_blocks(path, &offset, 1, block_size);
+    }
+    case FingerprintStage::samples:
+    {
+        uintmax_t offsets[sample_count];
+        for (uintmax_t i = 1; i <= sample_count; ++i)
+        {
+            offsets[i - 1] = size / (sample_count + 1) * i;
+        }
+        return reader.hash_blocks(path, offsets, sample_count, block_size);
+    }
+    default:
+        return reader.hash(path, 0);
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef FINGERPRINT_H
+#define FINGERPRINT_H
+
+#include "file_catalog.h"
+#include "file_reader.h"
+#include "prefix_hasher.h"
+
+#include <cstdint>
+#include <string>
+
+/**
+ * A stage of narrowing down the candidates for duplicates. Each stage hashes
+ * a different part of the files, and only files that share the hash with
+ * another file of the same size are passed to the next stage.
+ *
+ * prefix:  the beginning N bytes, where N is the argument 'bytes'
+ * head:    a longer beginning, 1/16 of the file but 64 KiB to 16 MiB
+ * tail:    the last 4096 bytes
+ * samples: 8 blocks of 4096 bytes at evenly spaced offsets
+ * full:    the whole file
+ */
+enum class FingerprintStage {prefix, head, tail, samples, full};
+
+/**
+ * Returns the stage with the given name. Throws std::invalid_argument if
+ * there is no such stage.
+ */
+FingerprintStage stage_from_name(const std::string &name);
+
+/**
+ * Returns the name of the given stage.
+ */
+const char *stage_name(FingerprintStage stage);
+
+/**
+ * Returns the number of bytes from the beginning of a file of the given size
+ * that the given stage hashes.
+ */
+uintmax_t stage_coverage(FingerprintStage stage, uintmax_t size,
+                         uintmax_t bytes);
+
+/**
+ * Returns false if the given stage can't tell apart files of the given size
+ * whose beginnings of the given length are known to be the same.
+ */
+bool stage_applies(FingerprintStage stage, uintmax_t size, uintmax_t bytes,
+                   uintmax_t covered);
+
+/**
+ * Returns the hash of the part of the given file that the given stage
+ * covers. Prefix hashes that are known are used, and the files are read
+ * with the given reader. The path of the file is put together in the given
+ * string, whose memory is reused. Throws FileException if the file can't be
+ * read.
+ */
+uint64_t fingerprint(FingerprintStage stage, FileId id,
+                     const FileCatalog &files,
+                     const PrefixHashes &prefix_hashes, uintmax_t bytes,
+                     FileReader &reader, std::string &path);
+
+#endif // FINGERPRINT_H
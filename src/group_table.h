@@ -0,0 +1,212 @@
+#ifndef GROUP_TABLE_H
+#define GROUP_TABLE_H
+
+#include "file_catalog.h"
+#include "utilities.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+/**
+ * Groups the ids of files by a key, such as the hash of their contents. A
+ * drop-in for an unordered_map from keys to vectors of ids, without an
+ * allocation for each key.
+ *
+ * Each key is numbered by the order in which it was first inserted, and the
+ * keys and the sizes of their groups are stored in dense arrays by their
+ * numbers. The numbers are found through a flat array of 8-byte slots with
+ * robin hood open addressing: a key that is further from its home slot takes
+ * the place of one that is closer, so that a lookup can stop as soon as it
+ * meets a key closer to home than the one it looks for. The ids are stored
+ * in one vector together with the numbers of their groups, and they are
+ * sorted into their groups in one pass only when the groups are read.
+ * All of the arrays are allocated from the given memory resource, such as
+ * the arena of a size group.
+ *
+ * Groups are visited in the order in which their keys were first inserted,
+ * and their ids in the order in which they were inserted.
+ */
+template <typename K>
+class GroupTable {
+        struct Slot {
+            uint32_t group;
+            // Distance from the home slot plus one, 0 meaning an empty slot
+            uint32_t distance;
+        };
+
+        std::pmr::vector<Slot> slots;
+        std::size_t mask;
+        // 64 minus the base-2 logarithm of the number of slots
+        unsigned shift;
+        std::pmr::vector<K> keys;
+        std::pmr::vector<uint32_t> group_sizes;
+        std::pmr::vector<std::pair<uint32_t, FileId>> members;
+
+        static uint64_t bits(uint64_t key) {return key;}
+        static uint64_t bits(const Digest128 &key) {return key.low ^ key.high;}
+
+        std::size_t home(const K &key) const
+        {
+            // Fibonacci hashing takes the high bits of the product, which
+            // depend on all the bits of the key, so that truncated digests
+            // and sizes spread over the table too
+            return static_cast<std::size_t>(
+                (bits(key) * 0x9e3779b97f4a7c15ull) >> shift);
+        }
+
+        void allocate(std::size_t key_count)
+        {
+            std::size_t count = 8;
+            shift = 61;
+            // The table is kept at most 80 % full
+            while (count * 4 < key_count * 5)
+            {
+                count *= 2;
+                --shift;
+            }
+            slots.assign(count, Slot{0, 0});
+            mask = count - 1;
+        }
+
+        /**
+         * Puts the given group, whose key isn't in the table, in its place.
+         */
+        void place(uint32_t group)
+        {
+            Slot slot{group, 1};
+            std::size_t index = home(keys[group]);
+            while (true)
+            {
+                Slot &current = slots[index];
+                if (current.distance == 0)
+                {
+                    current = slot;
+                    return;
+                }
+                if (current.distance < slot.distance)
+                {
+                    std::swap(current, slot);
+                }
+                ++slot.distance;
+                index = (index + 1) & mask;
+            }
+        }
+
+        void grow()
+        {
+            allocate(slots.size());
+            for (uint32_t group = 0; group < keys.size(); ++group)
+            {
+                place(group);
+            }
+        }
+
+    public:
+        /**
+         * Makes room for the given number of ids, assuming that most of them
+         * have keys of their own, so that the table doesn't have to grow
+         * while they are inserted.
+         */
+        explicit GroupTable(std::size_t expected_ids = 0,
+                            std::pmr::memory_resource *resource
+                                = std::pmr::get_default_resource())
+            : slots(resource), keys(resource), group_sizes(resource),
+              members(resource)
+        {
+            allocate(expected_ids);
+            keys.reserve(expected_ids);
+            group_sizes.reserve(expected_ids);
+            members.reserve(expected_ids);
+        }
+
+        /**
+         * Adds the given id to the group of the given key.
+         */
+        void insert(const K &key, FileId id)
+        {
+            std::size_t index = home(key);
+            for (uint32_t distance = 1; ; ++distance)
+            {
+                const Slot &slot = slots[index];
+                if (slot.distance < distance)
+                {
+                    // Either an empty slot, or a key closer to its home,
+                    // which the key would have displaced
+                    break;
+                }
+                if (keys[slot.group] == key)
+                {
+                    ++group_sizes[slot.group];
+                    members.emplace_back(slot.group, id);
+                    return;
+                }
+                index = (index + 1) & mask;
+            }
+
+            const uint32_t group = static_cast<uint32_t>(keys.size());
+            keys.push_back(key);
+            group_sizes.push_back(1);
+            members.emplace_back(group, id);
+            if (keys.size() * 5 > slots.size() * 4)
+            {
+                grow();
+            }
+            else
+            {
+                place(group);
+            }
+        }
+
+        /**
+         * Returns the number of groups, i.e., distinct keys.
+         */
+        std::size_t size() const
+        {
+            return keys.size();
+        }
+
+        /**
+         * Calls the given function with a pointer to the ids of every group
+         * that has at least two ids and their number, and returns the number
+         * of groups that have one id. The ids are valid only during the
+         * call.
+         */
+        template <typename Function>
+        std::size_t for_each_group(Function function) const
+        {
+            // Counting sort by group, after which ends[group] is the index
+            // after the last id of the group
+            std::pmr::memory_resource *resource =
+                members.get_allocator().resource();
+            std::pmr::vector<uint32_t> ends(keys.size(), resource);
+            uint32_t start = 0;
+            for (std::size_t group = 0; group < keys.size(); ++group)
+            {
+                ends[group] = start;
+                start += group_sizes[group];
+            }
+            std::pmr::vector<FileId> sorted(members.size(), resource);
+            for (const auto &member : members)
+            {
+                sorted[ends[member.first]++] = member.second;
+            }
+
+            std::size_t single_count = 0;
+            for (std::size_t group = 0; group < keys.size(); ++group)
+            {
+                if (group_sizes[group] == 1)
+                {
+                    ++single_count;
+                    continue;
+                }
+                function(sorted.data() + (ends[group] - group_sizes[group]),
+                         static_cast<std::size_t>(group_sizes[group]));
+            }
+            return single_count;
+        }
+};
+
+#endif // GROUP_TABLE_H
@@ -0,0 +1,279 @@
+#include "group_verifier.h"
+#include "memory_compare.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using std::cerr;
+using std::size_t;
+using std::vector;
+
+namespace {
+constexpr size_t page_size = 4096;
+
+// Split of a member that couldn't be read
+constexpr size_t unreadable = static_cast<size_t>(-1);
+}
+
+GroupVerifier::GroupVerifier(const FileCatalog &f, FileReader &r, size_t c_s,
+                             size_t m_o_f, size_t m)
+    : files(f), reader(r), chunk_size(std::max(c_s, size_t(1))),
+      max_open_files(m_o_f), memory(m)
+{
+}
+
+void GroupVerifier::verify(const FileId *ids, size_t count, uintmax_t size,
+                           vector<DuplicateVector> &sets)
+{
+    if (count > 1)
+    {
+        verify_same_size(ids, count, size, sets);
+    }
+}
+
+void GroupVerifier::verify_same_size(const FileId *ids, size_t id_count,
+                                     uintmax_t size,
+                                     vector<DuplicateVector> &sets)
+{
+    if (id_count == 2)
+    {
+        try
+        {
+            if (reader.compare(files.path(ids[0], paths[0]),
+                               files.path(ids[1], paths[1])))
+            {
+                sets.emplace_back(ids, ids + id_count);
+            }
+        }
+        catch(const FileException &e)
+        {
+            cerr << e.what() << '\n';
+        }
+        return;
+    }
+
+    const bool keep_open = id_count <= max_open_files;
+    members.clear();
+    for (size_t i = 0; i < id_count; ++i)
+    {
+        members.push_back(Member{ids[i], std::nullopt});
+        if (keep_open)
+        {
+            try
+            {
+                members.back().file.emplace(files.path(ids[i], paths[0]));
+                members.back().file->expect_sequential();
+            }
+            catch(const FileException &e)
+            {
+                cerr << e.what() << " [" << paths[0] << "]\n";
+                members.pop_back();
+            }
+        }
+    }
+
+    order.resize(members.size());
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        order[i] = i;
+    }
+    groups.clear();
+    if (order.size() > 1)
+    {
+        groups.push_back(Group{0, order.size(), 0});
+    }
+    while (!groups.empty())
+    {
+        const Group group = groups.back();
+        groups.pop_back();
+        if (group.offset < size)
+        {
+            split_group(group, size);
+            continue;
+        }
+        DuplicateVector identicals;
+        identicals.reserve(group.end - group.begin);
+        for (size_t i = group.begin; i < group.end; ++i)
+        {
+            identicals.push_back(members[order[i]].id);
+        }
+        sets.push_back(std::move(identicals));
+    }
+
+    // The files are closed, but the memory is kept
+    members.clear();
+}
+
+void GroupVerifier::split_group(const Group &group, uintmax_t size)
+{
+    const size_t member_count = group.end - group.begin;
+    const size_t group_chunk = std::min(chunk_size, std::max(page_size,
+        memory / member_count / page_size * page_size));
+    const size_t length = static_cast<size_t>(
+        std::min<uintmax_t>(group_chunk, size - group.offset));
+    chunk.resize(length);
+
+    // The members are split by the contents of their chunks. Each split
+    // keeps its first chunk for comparing the rest of the members.
+    counts.clear();
+    member_splits.resize(member_count);
+    for (size_t i = 0; i < member_count; ++i)
+    {
+        Member &member = members[order[group.begin + i]];
+        size_t count = 0;
+        try
+        {
+            count = read_chunk(member, group.offset, length);
+        }
+        catch(const FileException &e)
+        {
+            cerr << e.what() << " [" << files.path(member.id, paths[0])
+                 << "]\n";
+            member_splits[i] = unreadable;
+            continue;
+        }
+
+        size_t split = 0;
+        while (split < counts.size()
+               && (counts[split] != count
+                   || !memory_equal(first_chunks[split].data(),
+                                    chunk.data(), count)))
+        {
+            ++split;
+        }
+        if (split == counts.size())
+        {
+            if (first_chunks.size() == split)
+            {
+                first_chunks.emplace_back();
+            }
+            // The chunk is kept, and the buffer it replaces is reused
+            first_chunks[split].swap(chunk);
+            chunk.resize(length);
+            counts.push_back(count);
+        }
+        member_splits[i] = split;
+    }
+
+    // Counting sort of the members by split, which keeps their order within
+    // a split and leaves out the members that couldn't be read
+    split_ends.assign(counts.size(), 0);
+    for (const size_t split : member_splits)
+    {
+        if (split != unreadable)
+        {
+            ++split_ends[split];
+        }
+    }
+    size_t start = 0;
+    for (auto &end : split_ends)
+    {
+        const size_t split_size = end;
+        end = start;
+        start += split_size;
+    }
+    sorted.resize(member_count);
+    for (size_t i = 0; i < member_count; ++i)
+    {
+        if (member_splits[i] != unreadable)
+        {
+            sorted[split_ends[member_splits[i]]++] = order[group.begin + i];
+        }
+    }
+    std::copy(sorted.begin(), sorted.begin() + start,
+              order.begin() + group.begin);
+
+    size_t split_begin = 0;
+    for (const size_t split_end : split_ends)
+    {
+        if (split_end - split_begin > 1)
+        {
+            groups.push_back(Group{group.begin + split_begin,
+                                   group.begin + split_end,
+                                   group.offset + length});
+        }
+        split_begin = split_end;
+    }
+}
+
+size_t GroupVerifier::read_chunk(Member &member, uintmax_t offset,
+                                 size_t length)
+{
+    if (member.file)
+    {
+        return member.file->read(chunk.data(), length);
+    }
+    InputFile file(files.path(member.id, paths[0]));
+    file.skip(offset);
+    return file.read(chunk.data(), length);
+}
+
+void GroupVerifier::verify_in_memory(const FileId *ids, size_t count,
+                                     uintmax_t size,
+                                     vector<DuplicateVector> &sets)
+{
+    const size_t length = static_cast<size_t>(size);
+    pool.resize(count * length);
+
+    // Files that were read, and the number of bytes read from each. A file
+    // that was truncated after the scan is shorter than the others.
+    order.clear();
+    counts.resize(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        try
+        {
+            InputFile file(files.path(ids[i], paths[0]));
+            counts[i] = file.read(&pool[i * length], length);
+            order.push_back(i);
+        }
+        catch(const FileException &e)
+        {
+            cerr << e.what() << " [" << paths[0] << "]\n";
+        }
+    }
+
+    // Identical files end up next to each other
+    const auto data = [this, length](size_t i)
+    {
+        return pool.data() + i * length;
+    };
+    std::sort(order.begin(), order.end(),
+              [this, &data](size_t a, size_t b)
+              {
+                  if (counts[a] != counts[b])
+                  {
+                      return counts[a] < counts[b];
+                  }
+                  return std::memcmp(data(a), data(b), counts[a]) < 0;
+              });
+
+    for (size_t begin = 0; begin < order.size();)
+    {
+        const size_t first = order[begin];
+        size_t end = begin + 1;
+        while (end < order.size() && counts[order[end]] == counts[first]
+               && memory_equal(data(first), data(order[end]),
+                               counts[first]))
+        {
+            ++end;
+        }
+        if (end - begin > 1)
+        {
+            // The files are kept in their original order
+            std::sort(order.begin() + begin, order.begin() + end);
+            DuplicateVector identicals;
+            identicals.reserve(end - begin);
+            for (size_t i = begin; i < end; ++i)
+            {
+                identicals.push_back(ids[order[i]]);
+            }
+            sets.push_back(std::move(identicals));
+        }
+        begin = end;
+    }
+}
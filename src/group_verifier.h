@@ -0,0 +1,112 @@
+#ifndef GROUP_VERIFIER_H
+#define GROUP_VERIFIER_H
+
+#include "file_catalog.h"
+#include "file_reader.h"
+#include "input_file.h"
+#include "utilities.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+/**
+ * Finds the sets of identical files among candidates, such as files that have
+ * the same hash. All files of the same size are read chunk by chunk in
+ * lockstep, and a group is split whenever the chunks of its files differ, so
+ * each byte of each file is read at most once. A pair of files is compared
+ * with a FileReader, which can use memory maps.
+ *
+ * The files of a group are kept open unless there are more of them than the
+ * given limit, in which case they are reopened for every chunk. The chunks
+ * are small enough that a chunk of every file of a group fits in the given
+ * amount of memory, but they are at least a page long.
+ *
+ * Small files can also be read whole into a pooled buffer and compared there,
+ * so that they are read only once.
+ *
+ * The members of a group stay in place while it is split: the splits are
+ * ranges of an array of their indices, which is sorted by split after each
+ * chunk. Like the buffers, the arrays are kept from one group to the next,
+ * so once they have grown to the largest group, nothing is allocated but
+ * the sets that are found.
+ */
+class GroupVerifier {
+        struct Member {
+            FileId id;
+            std::optional<InputFile> file;
+        };
+
+        // Members whose indices are in the given range of the order, and
+        // which are identical up to the given offset
+        struct Group {
+            std::size_t begin;
+            std::size_t end;
+            uintmax_t offset;
+        };
+
+        const FileCatalog &files;
+        FileReader &reader;
+        const std::size_t chunk_size;
+        const std::size_t max_open_files;
+        const std::size_t memory;
+        // Paths of the files being opened or compared
+        std::string paths[2];
+        // Members of the group being verified, the order of their indices,
+        // and the groups whose next chunks are yet to be compared
+        std::vector<Member> members;
+        std::vector<std::size_t> order;
+        std::vector<Group> groups;
+        // Split of each member of the group being split, the ends of the
+        // splits in the order, and the order of the members sorted by split
+        std::vector<std::size_t> member_splits;
+        std::vector<std::size_t> split_ends;
+        std::vector<std::size_t> sorted;
+        // Chunk of the file being read, and the chunks that the splits of
+        // the current group start with, and their lengths
+        std::vector<char> chunk;
+        std::vector<std::vector<char>> first_chunks;
+        std::vector<std::size_t> counts;
+        // Whole files that are compared in memory, one after another
+        std::vector<char> pool;
+
+        void verify_same_size(const FileId *ids, std::size_t id_count,
+                              uintmax_t size,
+                              std::vector<DuplicateVector> &sets);
+        void split_group(const Group &group, uintmax_t size);
+        std::size_t read_chunk(Member &member, uintmax_t offset,
+                               std::size_t length);
+
+    public:
+        /**
+         * Parameter "c_s" is the maximum size of a chunk, "m_o_f" the maximum
+         * number of files that are kept open at once, and "m" the number of
+         * bytes that the chunks of a group may take.
+         */
+        GroupVerifier(const FileCatalog &f, FileReader &r, std::size_t c_s,
+                      std::size_t m_o_f, std::size_t m);
+
+        /**
+         * Adds the sets of at least two identical files among the given
+         * number of files that start from the given id, which all have the
+         * given size, to the given sets. Files that can't be read are
+         * reported and left out.
+         */
+        void verify(const FileId *ids, std::size_t count, uintmax_t size,
+                    std::vector<DuplicateVector> &sets);
+
+        /**
+         * Reads the given number of files that start from the given id, which
+         * all have the given size, whole into memory, and adds the sets of at
+         * least two identical files among them to the given sets. Each file
+         * is read once, regardless of the memory given for comparing a group.
+         * Files that can't be read are reported and left out.
+         */
+        void verify_in_memory(const FileId *ids, std::size_t count,
+                              uintmax_t size,
+                              std::vector<DuplicateVector> &sets);
+};
+
+#endif // GROUP_VERIFIER_H
@@ -0,0 +1,21 @@
+#include "xxh3_kernel.h"
+
+std::vector<const HashKernel*> supported_hash_kernels()
+{
+    std::vector<const HashKernel*> kernels;
+#ifdef HASH_KERNEL_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        kernels.push_back(&hash_kernel_avx2);
+    }
+#endif
+    kernels.push_back(&xxh3_kernel);
+    return kernels;
+}
+
+const HashKernel &hash_kernel()
+{
+    static const HashKernel &kernel = *supported_hash_kernels().front();
+    return kernel;
+}
@@ -0,0 +1,43 @@
+#ifndef HASH_KERNEL_H
+#define HASH_KERNEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * The XXH3 streaming functions compiled for one instruction set. xxHash
+ * chooses its vector code when it is compiled, so it is compiled once for the
+ * baseline of the target, and on x86-64 once more for AVX2. The kernel that
+ * the processor supports best is chosen once, when it is first needed.
+ *
+ * A state must be created, used and freed by the same kernel.
+ */
+struct HashKernel {
+    // Name of the instruction set, e.g. "avx2"
+    const char *name;
+    void *(*create_state)();
+    void (*free_state)(void *state);
+    void (*reset64)(void *state);
+    void (*update64)(void *state, const void *input, std::size_t length);
+    uint64_t (*digest64)(const void *state);
+    void (*reset128)(void *state);
+    void (*update128)(void *state, const void *input, std::size_t length);
+    void (*digest128)(const void *state, uint64_t &low, uint64_t &high);
+};
+
+// Compiled only on x86-64, which the build tells with HASH_KERNEL_AVX2
+extern const HashKernel hash_kernel_avx2;
+
+/**
+ * Returns the kernels that the processor supports, the fastest first. All of
+ * them calculate the same digests.
+ */
+std::vector<const HashKernel*> supported_hash_kernels();
+
+/**
+ * Returns the fastest kernel that the processor supports.
+ */
+const HashKernel &hash_kernel();
+
+#endif // HASH_KERNEL_H
@@ -0,0 +1,4 @@
+// Compiled with -mavx2, and used only if the processor supports AVX2
+#include "xxh3_kernel.h"
+
+const HashKernel hash_kernel_avx2 = xxh3_kernel;
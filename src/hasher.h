@@ -0,0 +1,104 @@
+#ifndef HASHER_H
+#define HASHER_H
+
+#include "file_catalog.h"
+#include "file_reader.h"
+#include "prefix_hasher.h"
+#include "utilities.h"
+
+#include <cstdint>
+#include <string>
+
+/**
+ * Policy that the engines hash files with, chosen by the type of the digest.
+ * Digests of up to 64 bits are XXH3-64 digests truncated to the type.
+ * Because a collision only makes files be compared, they can't be trusted
+ * to tell that files are identical.
+ */
+template <typename T>
+struct Hasher {
+    // Whether digests of whole files can be trusted
+    static constexpr bool trustworthy = false;
+
+    /**
+     * Returns the digest of the given number of bytes from the beginning of
+     * the given file, 0 meaning the whole file. Prefix hashes that are known
+     * are used. The path of the file is put together in the given string,
+     * whose memory is reused.
+     */
+    static T prefix(FileId id, const FileCatalog &files,
+                    const PrefixHashes &prefix_hashes, uintmax_t bytes,
+                    FileReader &reader, std::string &path)
+    {
+        return static_cast<T>(
+            prefix_hashes.get(id, files, bytes, reader, path));
+    }
+
+    /**
+     * Returns the digest of the whole file.
+     */
+    static T whole(FileId id, const FileCatalog &files, FileReader &reader,
+                   std::string &path)
+    {
+        return static_cast<T>(reader.hash(files.path(id, path), 0));
+    }
+
+    /**
+     * Returns the digest that corresponds to a 64-bit hash of a part of a
+     * file.
+     */
+    static T part(uint64_t hash)
+    {
+        return static_cast<T>(hash);
+    }
+
+    /**
+     * Returns true if the prefix digests of files of the given size can be
+     * trusted to tell that the files are identical.
+     */
+    static bool trusted_prefix(uintmax_t, uintmax_t)
+    {
+        return false;
+    }
+};
+
+/**
+ * XXH3-128 digests of whole files, which are trustworthy enough to tell that
+ * files are identical without comparing them. The beginnings of files only
+ * narrow down the candidates, so they are hashed with XXH3-64 like with the
+ * other digests, and the hashes calculated while scanning are used.
+ */
+template <>
+struct Hasher<Digest128> {
+    static constexpr bool trustworthy = true;
+
+    static Digest128 prefix(FileId id, const FileCatalog &files,
+                            const PrefixHashes &prefix_hashes,
+                            uintmax_t bytes, FileReader &reader,
+                            std::string &path)
+    {
+        if (trusted_prefix(files.size(id), bytes))
+        {
+            return whole(id, files, reader, path);
+        }
+        return part(prefix_hashes.get(id, files, bytes, reader, path));
+    }
+
+    static Digest128 whole(FileId id, const FileCatalog &files,
+                           FileReader &reader, std::string &path)
+    {
+        return reader.hash128(files.path(id, path));
+    }
+
+    static Digest128 part(uint64_t hash)
+    {
+        return Digest128{hash, 0};
+    }
+
+    static bool trusted_prefix(uintmax_t size, uintmax_t bytes)
+    {
+        return bytes == 0 || size <= bytes;
+    }
+};
+
+#endif // HASHER_H
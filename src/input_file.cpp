@@ -0,0 +1,163 @@
+#include "input_file.h"
+#include "utilities.h"
+
+#include <cerrno>
+#include <string>
+#include <system_error>
+#include <utility>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using std::size_t;
+using std::string;
+
+namespace {
+FileException error_from_errno()
+{
+    return FileException(std::error_code(errno, std::generic_category()));
+}
+}
+
+#ifdef __linux__
+InputFile::InputFile(const string &path) : offset(0)
+{
+    fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        throw error_from_errno();
+    }
+}
+
+InputFile::~InputFile()
+{
+    if (fd != -1)
+    {
+        close(fd);
+    }
+}
+
+InputFile::InputFile(InputFile &&other) noexcept
+    : fd(other.fd), offset(other.offset)
+{
+    other.fd = -1;
+}
+
+InputFile &InputFile::operator=(InputFile &&other) noexcept
+{
+    std::swap(fd, other.fd);
+    std::swap(offset, other.offset);
+    return *this;
+}
+
+void InputFile::expect_sequential()
+{
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+void InputFile::prefetch(size_t length)
+{
+    posix_fadvise(fd, offset, static_cast<off_t>(length),
+                  POSIX_FADV_WILLNEED);
+}
+
+size_t InputFile::read(char *buffer, size_t length)
+{
+    size_t count = 0;
+    while (count < length)
+    {
+        const ssize_t result = pread(fd, buffer + count, length - count,
+                                     offset);
+        if (result == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throw error_from_errno();
+        }
+        if (result == 0)
+        {
+            break;
+        }
+        count += static_cast<size_t>(result);
+        offset += result;
+    }
+    return count;
+}
+
+uintmax_t InputFile::position()
+{
+    return static_cast<uintmax_t>(offset);
+}
+
+void InputFile::skip(uintmax_t length)
+{
+    offset += static_cast<off_t>(length);
+}
+
+uintmax_t InputFile::size() const
+{
+    struct stat s;
+    if (fstat(fd, &s) == -1)
+    {
+        throw error_from_errno();
+    }
+    return static_cast<uintmax_t>(s.st_size);
+}
+#else
+InputFile::InputFile(const string &path)
+    : stream(path, std::ios::binary | std::ios::in)
+{
+    if (!stream)
+    {
+        throw error_from_errno();
+    }
+}
+
+InputFile::~InputFile()
+{
+}
+
+InputFile::InputFile(InputFile &&other) noexcept
+    : stream(std::move(other.stream))
+{
+}
+
+InputFile &InputFile::operator=(InputFile &&other) noexcept
+{
+    stream = std::move(other.stream);
+    return *this;
+}
+
+void InputFile::expect_sequential()
+{
+}
+
+void InputFile::prefetch(size_t)
+{
+}
+
+size_t InputFile::read(char *buffer, size_t length)
+{
+    stream.read(buffer, static_cast<std::streamsize>(length));
+    if (stream.bad())
+    {
+        throw error_from_errno();
+    }
+    return static_cast<size_t>(stream.gcount());
+}
+
+uintmax_t InputFile::position()
+{
+    return static_cast<uintmax_t>(stream.tellg());
+}
+
+void InputFile::skip(uintmax_t length)
+{
+    stream.seekg(static_cast<std::streamoff>(length), std::ios::cur);
+}
+#endif
@@ -0,0 +1,73 @@
+#ifndef INPUT_FILE_H
+#define INPUT_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#ifdef __linux__
+#include <sys/types.h>
+#else
+#include <fstream>
+#endif
+
+/**
+ * A file that is read sequentially from the beginning. Throws FileException
+ * if the file can't be opened or read.
+ */
+class InputFile {
+#ifdef __linux__
+        int fd;
+        off_t offset;
+#else
+        std::ifstream stream;
+#endif
+
+    public:
+        explicit InputFile(const std::string &path);
+        ~InputFile();
+        InputFile(const InputFile &) = delete;
+        InputFile &operator=(const InputFile &) = delete;
+        InputFile(InputFile &&other) noexcept;
+        InputFile &operator=(InputFile &&other) noexcept;
+
+        /**
+         * Tells the kernel that the whole file is going to be read, which
+         * makes its readahead more aggressive.
+         */
+        void expect_sequential();
+
+        /**
+         * Asks the kernel to start reading the given number of bytes that
+         * follow the data read so far. Returns immediately.
+         */
+        void prefetch(std::size_t length);
+
+        /**
+         * Reads at most the given number of bytes into the buffer. Returns
+         * the number of bytes read, which is less than asked only at the end
+         * of the file.
+         */
+        std::size_t read(char *buffer, std::size_t length);
+
+        /**
+         * Returns the number of bytes read or skipped so far.
+         */
+        uintmax_t position();
+
+        /**
+         * Moves the position forward without reading.
+         */
+        void skip(uintmax_t length);
+
+#ifdef __linux__
+        int descriptor() const {return fd;}
+
+        /**
+         * Returns the current size of the file.
+         */
+        uintmax_t size() const;
+#endif
+};
+
+#endif // INPUT_FILE_H
@@ -34,6 +34,10 @@ int main(int argc, char *argv[])
             deal_with_duplicates(
                 action, find_duplicates<uint32_t>(cl_args));
             break;
+        case 16:
+            deal_with_duplicates(
+                action, find_duplicates<Digest128>(cl_args));
+            break;
         default:
             deal_with_duplicates(
                 action, find_duplicates<uint64_t>(cl_args));
@@ -0,0 +1,134 @@
+#include "memory_compare.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define MEMORY_COMPARE_X86
+#include <immintrin.h>
+#endif
+
+using std::size_t;
+
+namespace {
+#ifdef MEMORY_COMPARE_X86
+// Number of vectors that are compared before checking for a difference, so
+// that the loads don't wait for the branch
+constexpr size_t unroll = 8;
+
+__attribute__((target("avx512f")))
+bool equal_avx512(const char *a, const char *b, size_t length)
+{
+    constexpr size_t step = unroll * sizeof(__m512i);
+    size_t i = 0;
+    for (; i + step <= length; i += step)
+    {
+        __m512i difference = _mm512_setzero_si512();
+#pragma GCC unroll 8
+        for (size_t vector = 0; vector < unroll; ++vector)
+        {
+            const size_t offset = i + vector * sizeof(__m512i);
+            difference = _mm512_or_si512(difference, _mm512_xor_si512(
+                _mm512_loadu_si512(a + offset),
+                _mm512_loadu_si512(b + offset)));
+        }
+        if (_mm512_test_epi64_mask(difference, difference) != 0)
+        {
+            return false;
+        }
+    }
+    return std::memcmp(a + i, b + i, length - i) == 0;
+}
+
+__attribute__((target("avx2")))
+bool equal_avx2(const char *a, const char *b, size_t length)
+{
+    constexpr size_t step = unroll * sizeof(__m256i);
+    size_t i = 0;
+    for (; i + step <= length; i += step)
+    {
+        const auto *va = reinterpret_cast<const __m256i*>(a + i);
+        const auto *vb = reinterpret_cast<const __m256i*>(b + i);
+        __m256i difference = _mm256_setzero_si256();
+#pragma GCC unroll 8
+        for (size_t vector = 0; vector < unroll; ++vector)
+        {
+            difference = _mm256_or_si256(difference, _mm256_xor_si256(
+                _mm256_loadu_si256(va + vector),
+                _mm256_loadu_si256(vb + vector)));
+        }
+        if (!_mm256_testz_si256(difference, difference))
+        {
+            return false;
+        }
+    }
+    return std::memcmp(a + i, b + i, length - i) == 0;
+}
+
+bool equal_sse2(const char *a, const char *b, size_t length)
+{
+    constexpr size_t step = unroll * sizeof(__m128i);
+    size_t i = 0;
+    for (; i + step <= length; i += step)
+    {
+        const auto *va = reinterpret_cast<const __m128i*>(a + i);
+        const auto *vb = reinterpret_cast<const __m128i*>(b + i);
+        __m128i difference = _mm_setzero_si128();
+#pragma GCC unroll 8
+        for (size_t vector = 0; vector < unroll; ++vector)
+        {
+            difference = _mm_or_si128(difference, _mm_xor_si128(
+                _mm_loadu_si128(va + vector), _mm_loadu_si128(vb + vector)));
+        }
+        // SSE2 has no test instruction, so compare the bytes to zero
+        const __m128i zero = _mm_setzero_si128();
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(difference, zero)) != 0xffff)
+        {
+            return false;
+        }
+    }
+    return std::memcmp(a + i, b + i, length - i) == 0;
+}
+
+struct EqualKernel {
+    const char *name;
+    bool (*equal)(const char*, const char*, size_t);
+};
+
+const EqualKernel &select_kernel()
+{
+    static const EqualKernel avx512 = {"avx512", equal_avx512};
+    static const EqualKernel avx2 = {"avx2", equal_avx2};
+    static const EqualKernel sse2 = {"sse2", equal_sse2};
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        return avx512;
+    }
+    return __builtin_cpu_supports("avx2") ? avx2 : sse2;
+}
+
+const EqualKernel &equal_kernel()
+{
+    static const EqualKernel &kernel = select_kernel();
+    return kernel;
+}
+#endif
+}
+
+bool memory_equal(const char *a, const char *b, size_t length)
+{
+#ifdef MEMORY_COMPARE_X86
+    return equal_kernel().equal(a, b, length);
+#else
+    return std::memcmp(a, b, length) == 0;
+#endif
+}
+
+const char *memory_equal_kernel()
+{
+#ifdef MEMORY_COMPARE_X86
+    return equal_kernel().name;
+#else
+    return "memcmp";
+#endif
+}
@@ -0,0 +1,20 @@
+#ifndef MEMORY_COMPARE_H
+#define MEMORY_COMPARE_H
+
+#include <cstddef>
+
+/**
+ * Returns true if the given blocks of memory of the given length have the same
+ * contents. Unlike memcmp, doesn't find out which block is greater, so it can
+ * stop at the first differing vector of bytes. Uses AVX-512 or AVX2 if the
+ * processor supports them, and SSE2 otherwise on x86-64.
+ */
+bool memory_equal(const char *a, const char *b, std::size_t length);
+
+/**
+ * Returns the name of the instruction set that memory_equal uses, which is
+ * chosen once, when it is first needed.
+ */
+const char *memory_equal_kernel();
+
+#endif // MEMORY_COMPARE_H
@@ -1,9 +1,12 @@
 #include "cxxopts/cxxopts.hpp"
+#include "file_reader.h"
+#include "fingerprint.h"
 #include "parse.h"
 #include "utilities.h"
 
 #include <filesystem>
 #include <iostream>
+#include <stdexcept>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -73,7 +76,7 @@ ArgMap parse(int argc, char* argv[])
     try
     {
         // Possible sizes for the hash digest in bytes
-        const vector<int> hash_sizes = {1,2,4,8};
+        const vector<int> hash_sizes = {1,2,4,8,16};
         constexpr int DEFAULT_HASH_SIZE = 8;
 
         string hash_sizes_str;
@@ -89,7 +92,8 @@ ArgMap parse(int argc, char* argv[])
         options
             .positional_help("path1 [path2] [path3]...\nBy default, the user "
             "is prompted to select which duplicates to keep.\nSymbolic links, "
-            "extra hard links and empty files are ignored.")
+            "extra hard links and empty files are ignored.\nPseudo file "
+            "systems such as /proc and /sys are skipped.")
             .show_positional_help();
 
         // Positional argument that won't be printed in help
@@ -145,28 +149,162 @@ ArgMap parse(int argc, char* argv[])
                 "0 means that the whole file is hashed.",
                 cxxopts::value<uintmax_t>()->default_value("4096"), "N")
 
+            ("buffer-size", "Size of the buffers that files are read into, "
+                "in bytes.",
+                cxxopts::value<uintmax_t>()->default_value(
+                std::to_string(FileReader::default_buffer_size)), "N")
+
+            ("compare-memory", "Maximum number of bytes that are read into "
+                "memory at once when comparing a group of files that have the "
+                "same hash. A chunk of every file of the group is read at "
+                "once, but at least 4096 bytes of each. Files of the same size "
+                "that are no longer than the argument 'bytes' are read whole "
+                "and compared without hashing, if all of them fit. The "
+                "threads given by the argument 'hash-threads' share the "
+                "memory.",
+                cxxopts::value<uintmax_t>()->default_value("67108864"), "N")
+
+            ("exclude", "Skip files and directories whose name matches the "
+                "given wildcard pattern, such as '.git' or '*.tmp'. The "
+                "contents of skipped directories are not scanned. Several "
+                "patterns can be given separated by commas or by repeating "
+                "the argument.",
+                cxxopts::value<vector<string>>(), "GLOB")
+
+            ("external-memory", "Keep at most N bytes of the candidates "
+                "for deduplication in memory. The candidates are sorted in "
+                "runs that are written to temporary files in the directory "
+                "given by the environment variable TMPDIR, or the system's "
+                "temporary directory, and merged. Doesn't affect the result "
+                "of the program. 0 means that the candidates are kept in "
+                "memory. Mutually exclusive with the arguments 'no-hash', "
+                "'two' and 'vector'.",
+                cxxopts::value<uintmax_t>()->default_value("0"), "N")
+
+            ("hash-queue-depth", "Number of files that are opened and read "
+                "with io_uring at once when hashing the beginnings of files. "
+                "0 means that the files are read synchronously. Has no effect "
+                "on systems without io_uring or with the argument 'no-hash'.",
+                cxxopts::value<uintmax_t>()->default_value("0"), "N")
+
+            ("hash-threads", "Number of threads that hash and compare the "
+                "files. Groups of files of the same size are processed in "
+                "parallel. 0 means one thread per hardware thread.",
+                cxxopts::value<uintmax_t>()->default_value("1"), "N")
+
             ("h,help", "Print this help")
 
+            ("include", "Only scan files whose name matches the given "
+                "wildcard pattern, such as '*.jpg'. Directories are scanned "
+                "regardless. Several patterns can be given separated by "
+                "commas or by repeating the argument.",
+                cxxopts::value<vector<string>>(), "GLOB")
+
+            ("low-memory", "Scan the paths twice: first only counting the "
+                "sizes of the files, and then storing only the files whose "
+                "size is shared by another file. Takes less memory when most "
+                "files have a unique size, but scanning takes longer.",
+                cxxopts::value<bool>()->default_value("false"))
+
+            ("max-size", "Skip files larger than N bytes. 0 means no limit.",
+                cxxopts::value<uintmax_t>()->default_value("0"), "N")
+
+            ("memory-limit", "Maximum number of bytes of memory that the "
+                "beginnings of files take with the argument 'no-hash', "
+                "divided between the threads. The beginnings of a group of "
+                "files of the same size that would take more are kept in a "
+                "temporary file in the directory given by the environment "
+                "variable TMPDIR, or the system's temporary directory, which "
+                "the system writes to disk as memory runs low. 0 means no "
+                "limit.",
+                cxxopts::value<uintmax_t>()->default_value("0"), "N")
+
+            ("min-size", "Skip files smaller than N bytes.",
+                cxxopts::value<uintmax_t>()->default_value("0"), "N")
+
+            ("mmap", "Compare files of at least N bytes through memory maps "
+                "instead of reading them into buffers. Faster for large files, "
+                "but a file that is truncated during its comparison terminates "
+                "the program. 0 means that memory maps are not used.",
+                cxxopts::value<uintmax_t>()->default_value("0"), "N")
+
             ("n,no-hash", "In the initial comparison step, use file contents "
                 "instead of hash digests. Doesn't affect the result of the "
-                "program. Mutually exclusive with the argument 'two'. "
-                "Implies the argument 'vector', and is mutually exclusive with "
-                "it.",
+                "program. Mutually exclusive with the arguments "
+                "'external-memory' and 'two'. Implies the argument 'vector', "
+                "and is mutually exclusive with it.",
+                cxxopts::value<bool>()->default_value("false"))
+
+            ("x,one-file-system", "Don't scan directories that are on other "
+                "file systems than the given path that they were found in.",
+                cxxopts::value<bool>()->default_value("false"))
+
+            ("open-files", "Maximum number of files that are kept open at "
+                "once when comparing a group of files that have the same "
+                "hash. Files of larger groups are reopened for every chunk. "
+                "The threads given by the argument 'hash-threads' share the "
+                "limit.",
+                cxxopts::value<uintmax_t>()->default_value("256"), "N")
+
+            ("p,pipeline", "Hash the beginnings of files while the paths are "
+                "still being scanned, as soon as another file of the same "
+                "size is found. Groups of files that are later compared in "
+                "memory, because they fit in the argument 'compare-memory', "
+                "are hashed all the same. Doesn't affect the result of the "
+                "program. Has no effect with the argument 'no-hash'.",
                 cxxopts::value<bool>()->default_value("false"))
 
             ("r,recurse", "Search the paths for duplicates recursively",
                 cxxopts::value<bool>()->default_value("false"))
 
-            ("t,two", "Use two layers of unordered maps to store the "
-                "candidates for deduplication. Doesn't affect the result of "
-                "the program. Mutually exclusive with the arguments 'no-hash' "
-                "and 'vector'.",
+            ("scan-queue-depth", "Number of metadata requests submitted to "
+                "io_uring at once when scanning. 0 means that the metadata is "
+                "fetched synchronously. Has no effect on systems without "
+                "io_uring.",
+                cxxopts::value<uintmax_t>()->default_value("0"), "N")
+
+            ("j,scan-threads", "Number of threads used for scanning the "
+                "paths for files. 0, the default, means one thread per "
+                "hardware thread.",
+                cxxopts::value<uintmax_t>()->default_value("0"), "N")
+
+            ("stages", "Stages in which the candidates for duplicates are "
+                "narrowed down with the argument 'two', in order. Each stage "
+                "hashes a part of the files: 'prefix' the beginning of "
+                "the length given by the argument 'bytes', 'head' 1/16 of the "
+                "file but 64 KiB to 16 MiB from the beginning, 'tail' the last "
+                "4096 bytes, 'samples' 8 blocks of 4096 bytes at evenly spaced "
+                "offsets, and 'full' the whole file. The number of files "
+                "eliminated by each stage is printed.",
+                cxxopts::value<vector<string>>()->default_value(
+                "prefix,tail,samples"), "LIST")
+
+            ("trust-hash", "Consider files identical if the 128-bit hash "
+                "digests of their whole contents are the same, without "
+                "comparing the files. Halves the reading of duplicates, but "
+                "files that differ are taken as identical if their digests "
+                "collide. Requires the argument 'hash' to be 16. Has effect "
+                "only when whole files are hashed, because the argument "
+                "'bytes' is 0 or at least the size of the files, or with the "
+                "stage 'full' of the argument 'two'.",
                 cxxopts::value<bool>()->default_value("false"))
 
-            ("v,vector", "Use a vector instead of an unordered map to store "
-                "the candidates for deduplication. Doesn't affect the result " 
+            ("t,two", "Narrow down the candidates for deduplication in the "
+                "stages given by the argument 'stages', grouping them by hash "
+                "in a new hash table in each stage. Doesn't affect the result "
                 "of the program. Mutually exclusive with the arguments "
-                "'no-hash' and 'two'.",
+                "'external-memory', 'no-hash' and 'vector'.",
+                cxxopts::value<bool>()->default_value("false"))
+
+            ("v,vector", "Use a sorted vector instead of a hash table to "
+                "store the candidates for deduplication. Doesn't affect the "
+                "result of the program. Mutually exclusive with the arguments "
+                "'external-memory', 'no-hash' and 'two'.",
+                cxxopts::value<bool>()->default_value("false"))
+
+            ("verbose", "Print details of how the files are processed, such "
+                "as the instruction sets that the hash and comparison "
+                "kernels chosen for the processor use.",
                 cxxopts::value<bool>()->default_value("false"))
         ;
 
@@ -264,12 +402,72 @@ ArgMap parse(int argc, char* argv[])
             }
         }
         cl_args["hash"] = result["hash"].as<int>();
+        cl_args["hash-queue-depth"] = 
+            result["hash-queue-depth"].as<uintmax_t>();
+        cl_args["hash-threads"] = result["hash-threads"].as<uintmax_t>();
         
         cl_args["bytes"] = result["bytes"].as<uintmax_t>();
+        cl_args["buffer-size"] = result["buffer-size"].as<uintmax_t>();
+        if (std::get<uintmax_t>(cl_args.at("buffer-size")) == 0)
+        {
+            cerr << "Invalid argument 'buffer-size': must be greater than 0\n";
+            throw EndException(1);
+        }
+        cl_args["low-memory"] = 
+            result.count("low-memory") > 0 ? true : false;
+        cl_args["min-size"] = result["min-size"].as<uintmax_t>();
+        cl_args["max-size"] = result["max-size"].as<uintmax_t>();
+        if (std::get<uintmax_t>(cl_args.at("max-size")) != 0
+            && std::get<uintmax_t>(cl_args.at("min-size"))
+               > std::get<uintmax_t>(cl_args.at("max-size")))
+        {
+            cerr << "Invalid argument 'min-size': must not be greater than "
+                    "the argument 'max-size'\n";
+            throw EndException(1);
+        }
+        cl_args["memory-limit"] = result["memory-limit"].as<uintmax_t>();
+        cl_args["external-memory"] = 
+            result["external-memory"].as<uintmax_t>();
+        cl_args["mmap"] = result["mmap"].as<uintmax_t>();
+        cl_args["include"] = result.count("include") 
+            ? result["include"].as<vector<string>>() : vector<string>();
+        cl_args["exclude"] = result.count("exclude") 
+            ? result["exclude"].as<vector<string>>() : vector<string>();
+        cl_args["one-file-system"] = 
+            result.count("one-file-system") > 0 ? true : false;
+        cl_args["compare-memory"] = result["compare-memory"].as<uintmax_t>();
+        cl_args["open-files"] = result["open-files"].as<uintmax_t>();
+        cl_args["pipeline"] = result.count("pipeline") > 0 ? true : false;
         cl_args["recurse"] = result.count("recurse") > 0 ? true : false;
+        cl_args["scan-threads"] = result["scan-threads"].as<uintmax_t>();
+        cl_args["scan-queue-depth"] = 
+            result["scan-queue-depth"].as<uintmax_t>();
         cl_args["no-hash"] = result.count("no-hash") > 0 ? true : false;
+        cl_args["stages"] = result["stages"].as<vector<string>>();
+        for (const auto &stage : 
+             std::get<vector<string>>(cl_args.at("stages")))
+        {
+            try
+            {
+                stage_from_name(stage);
+            }
+            catch(const std::invalid_argument &e)
+            {
+                cerr << "Invalid argument 'stages': " << e.what() << '\n';
+                throw EndException(1);
+            }
+        }
+        cl_args["trust-hash"] = result.count("trust-hash") > 0 ? true : false;
+        if (std::get<bool>(cl_args.at("trust-hash")) 
+            && std::get<int>(cl_args.at("hash")) != 16)
+        {
+            cerr << "Invalid argument 'trust-hash': requires the argument "
+                    "'hash' to be 16\n";
+            throw EndException(1);
+        }
         cl_args["two"] = result.count("two") > 0 ? true : false;
         cl_args["vector"] = result.count("vector") > 0 ? true : false;
+        cl_args["verbose"] = result.count("verbose") > 0 ? true : false;
 
         int index_argument_count = 0;
         if (std::get<bool>(cl_args.at("no-hash")))
@@ -284,10 +482,14 @@ ArgMap parse(int argc, char* argv[])
         {
             ++index_argument_count;
         }
+        if (std::get<uintmax_t>(cl_args.at("external-memory")) != 0)
+        {
+            ++index_argument_count;
+        }
         if (index_argument_count > 1)
         {
-            cerr << "Only one of arguments 'no-hash', 'two' and 'vector' "
-                    "can be specified." << '\n';
+            cerr << "Only one of arguments 'external-memory', 'no-hash', "
+                    "'two' and 'vector' can be specified." << '\n';
             throw EndException(1);
         }
         
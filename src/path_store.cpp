@@ -0,0 +1,121 @@
+#include "path_store.h"
+
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using std::size_t;
+using std::string;
+
+namespace {
+/**
+ * Size of a block in the name arena. A name is never split between blocks.
+ */
+constexpr size_t block_size = 1 << 20;
+
+/**
+ * Parent of directories that were added as roots.
+ */
+constexpr DirId no_parent = std::numeric_limits<DirId>::max();
+}
+
+PathStore::PathStore() : block_used(block_size)
+{
+}
+
+PathStore::PathStore(const PathStore &other)
+    : directories(other.directories), block_used(other.block_used)
+{
+    blocks.reserve(other.blocks.size());
+    for (const auto &block : other.blocks)
+    {
+        blocks.emplace_back(new char[block_size]);
+        std::memcpy(blocks.back().get(), block.get(), block_size);
+    }
+}
+
+uint64_t PathStore::add_name(const char *name, size_t length)
+{
+    if (length + 1 > block_size)
+    {
+        throw std::length_error("Path component is too long");
+    }
+    if (block_used + length + 1 > block_size)
+    {
+        blocks.emplace_back(new char[block_size]);
+        block_used = 0;
+    }
+    const uint64_t offset = (blocks.size() - 1) * block_size + block_used;
+    std::memcpy(blocks.back().get() + block_used, name, length + 1);
+    block_used += length + 1;
+    return offset;
+}
+
+DirId PathStore::add_root(const string &path)
+{
+    directories.push_back(Directory{no_parent,
+                                    add_name(path.c_str(), path.size())});
+    return static_cast<DirId>(directories.size() - 1);
+}
+
+DirId PathStore::add_directory(DirId parent, const char *name)
+{
+    if (directories.size() == no_parent)
+    {
+        throw std::length_error("Too many directories");
+    }
+    directories.push_back(Directory{parent, add_name(name, std::strlen(name))});
+    return static_cast<DirId>(directories.size() - 1);
+}
+
+PathHandle PathStore::add_file(DirId dir, const char *name)
+{
+    return PathHandle{dir, add_name(name, std::strlen(name))};
+}
+
+const char *PathStore::name(PathHandle file) const
+{
+    return blocks[file.name / block_size].get() + file.name % block_size;
+}
+
+void PathStore::append_directory_path(DirId dir, string &out) const
+{
+    const Directory &directory = directories[dir];
+    const char *dir_name = name(PathHandle{dir, directory.name});
+    if (directory.parent != no_parent)
+    {
+        append_directory_path(directory.parent, out);
+        if (out.empty() || out.back() != '/')
+        {
+            out += '/';
+        }
+    }
+    out += dir_name;
+}
+
+string PathStore::directory_path(DirId dir) const
+{
+    string out;
+    append_directory_path(dir, out);
+    return out;
+}
+
+string PathStore::path(PathHandle file) const
+{
+    string out;
+    path(file, out);
+    return out;
+}
+
+void PathStore::path(PathHandle file, string &out) const
+{
+    out.clear();
+    append_directory_path(file.dir, out);
+    if (out.empty() || out.back() != '/')
+    {
+        out += '/';
+    }
+    out += name(file);
+}
@@ -0,0 +1,89 @@
+#ifndef PATH_STORE_H
+#define PATH_STORE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Identifies a directory in a PathStore.
+ */
+using DirId = uint32_t;
+
+/**
+ * Identifies a file in a PathStore by the directory it is in and the offset of
+ * its name in the name arena.
+ */
+struct PathHandle {
+    DirId dir;
+    uint64_t name;
+};
+
+/**
+ * Stores paths compactly. Each directory is stored once, as its name and the
+ * id of its parent directory, and each file as a name and the id of its
+ * directory. The names are stored in an arena of large blocks. Full paths are
+ * put together only when needed.
+ *
+ * Not thread safe: writes must not happen concurrently with each other or with
+ * reads.
+ */
+class PathStore {
+        struct Directory {
+            DirId parent;
+            uint64_t name;
+        };
+
+        std::vector<Directory> directories;
+        std::vector<std::unique_ptr<char[]>> blocks;
+        std::size_t block_used;
+
+        uint64_t add_name(const char *name, std::size_t length);
+        void append_directory_path(DirId dir, std::string &out) const;
+
+    public:
+        PathStore();
+        PathStore(const PathStore &other);
+        PathStore(PathStore &&other) = default;
+        PathStore &operator=(PathStore &&other) = default;
+
+        /**
+         * Adds a directory that has no parent in the store, such as a path
+         * given on the command line.
+         */
+        DirId add_root(const std::string &path);
+
+        /**
+         * Adds a directory with the given name to the given parent directory.
+         */
+        DirId add_directory(DirId parent, const char *name);
+
+        /**
+         * Adds a file with the given name to the given directory.
+         */
+        PathHandle add_file(DirId dir, const char *name);
+
+        /**
+         * Returns the name of the given file without its directory.
+         */
+        const char *name(PathHandle file) const;
+
+        /**
+         * Returns the full path of the given directory.
+         */
+        std::string directory_path(DirId dir) const;
+
+        /**
+         * Returns the full path of the given file.
+         */
+        std::string path(PathHandle file) const;
+
+        /**
+         * Puts the full path of the given file in the given string, reusing
+         * its memory.
+         */
+        void path(PathHandle file, std::string &out) const;
+};
+
+#endif // PATH_STORE_H
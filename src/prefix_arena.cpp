@@ -0,0 +1,149 @@
+#include "prefix_arena.h"
+#include "radix_sort.h"
+#include "scratch_file.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <system_error>
+#include <utility>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using std::cerr;
+using std::size_t;
+using std::vector;
+
+namespace {
+#ifdef __linux__
+/**
+ * Returns a shared memory map of a new scratch file of the given length. The
+ * file is removed when the map is unmapped.
+ */
+char *map_scratch_file(size_t length)
+{
+    ScratchFile file;
+    if (ftruncate(file.descriptor(), static_cast<off_t>(length)) == -1)
+    {
+        throw std::system_error(errno, std::system_category(),
+                                "Can't resize a temporary file");
+    }
+    // The map keeps the file open
+    void *data = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      file.descriptor(), 0);
+    if (data == MAP_FAILED)
+    {
+        throw std::system_error(errno, std::system_category(),
+                                "Can't map a temporary file");
+    }
+    return static_cast<char*>(data);
+}
+#endif
+
+/**
+ * Returns the first 8 bytes of the given slot of the given width as a number
+ * whose order is the order of the bytes, padded with zeros at the end of
+ * the slot.
+ */
+uint64_t order_key(const char *slot, size_t width)
+{
+    uint64_t key = 0;
+    for (size_t i = 0; i < 8; ++i)
+    {
+        key <<= 8;
+        if (i < width)
+        {
+            key |= static_cast<unsigned char>(slot[i]);
+        }
+    }
+    return key;
+}
+}
+
+PrefixArena::PrefixArena(size_t w, size_t slot_count, uintmax_t memory_limit,
+                         std::pmr::memory_resource *r)
+    : width(w), length(w * slot_count), resource(r), data(nullptr),
+      mapped(false)
+{
+#ifdef __linux__
+    if (memory_limit != 0 && length > memory_limit)
+    {
+        try
+        {
+            data = map_scratch_file(length);
+            mapped = true;
+            return;
+        }
+        catch(const std::system_error &e)
+        {
+            cerr << e.what() << '\n';
+        }
+    }
+#else
+    (void)memory_limit;
+#endif
+    data = static_cast<char*>(resource->allocate(std::max<size_t>(length, 1),
+                                                 1));
+    std::memset(data, 0, length);
+}
+
+PrefixArena::~PrefixArena()
+{
+#ifdef __linux__
+    if (mapped)
+    {
+        munmap(data, length);
+        return;
+    }
+#endif
+    resource->deallocate(data, std::max<size_t>(length, 1), 1);
+}
+
+std::pmr::vector<FileId> PrefixArena::order(size_t slot_count) const
+{
+    std::pmr::vector<std::pair<uint64_t, FileId>> entries(slot_count,
+                                                          resource);
+    for (size_t index = 0; index < slot_count; ++index)
+    {
+        entries[index] = {order_key(slot(index), width),
+                          static_cast<FileId>(index)};
+    }
+    // Stable, so that equal slots stay in the order of their indices
+    radix_sort(entries, 1);
+
+    // Slots that share their first 8 bytes are compared from there on
+    const size_t offset = std::min<size_t>(8, width);
+    for (size_t i = 0; i < entries.size();)
+    {
+        size_t j = i + 1;
+        while (j < entries.size() && entries[j].first == entries[i].first)
+        {
+            ++j;
+        }
+        if (j - i > 1)
+        {
+            std::sort(entries.begin() + i, entries.begin() + j,
+                      [this, offset](const auto &a, const auto &b)
+                      {
+                          const int order = std::memcmp(
+                              slot(a.second) + offset,
+                              slot(b.second) + offset, width - offset);
+                          return order < 0
+                              || (order == 0 && a.second < b.second);
+                      });
+        }
+        i = j;
+    }
+
+    std::pmr::vector<FileId> indices(resource);
+    indices.reserve(entries.size());
+    for (const auto &entry : entries)
+    {
+        indices.push_back(entry.second);
+    }
+    return indices;
+}
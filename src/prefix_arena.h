@@ -0,0 +1,64 @@
+#ifndef PREFIX_ARENA_H
+#define PREFIX_ARENA_H
+
+#include "file_catalog.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+/**
+ * Stores the beginnings of files in slots of the same width, one after
+ * another in one block of memory, instead of in a vector for each file.
+ *
+ * If the slots would take more than the given memory limit, the block is a
+ * memory map of a ScratchFile, whose pages the system can write out to disk
+ * and drop when memory runs low. If the file can't be created, or the system
+ * is not Linux, the block is allocated in memory regardless. Memory comes
+ * from the given memory resource, like the order of the slots.
+ */
+class PrefixArena {
+        std::size_t width;
+        std::size_t length;
+        std::pmr::memory_resource *resource;
+        char *data;
+        bool mapped;
+
+    public:
+        /**
+         * Makes room for the given number of slots of the given width. A
+         * memory limit of 0 means no limit.
+         */
+        PrefixArena(std::size_t w, std::size_t slot_count,
+                    uintmax_t memory_limit,
+                    std::pmr::memory_resource *r
+                        = std::pmr::get_default_resource());
+        ~PrefixArena();
+        PrefixArena(const PrefixArena &) = delete;
+        PrefixArena &operator=(const PrefixArena &) = delete;
+
+        std::size_t slot_width() const {return width;}
+        char *slot(std::size_t index) {return data + index * width;}
+        const char *slot(std::size_t index) const
+        {
+            return data + index * width;
+        }
+
+        /**
+         * Returns true if the slots are in a temporary file.
+         */
+        bool spilled() const {return mapped;}
+
+        /**
+         * Returns the indices of the given number of first slots, sorted by
+         * the contents of the slots, and equal slots by their indices.
+         *
+         * The slots are radix sorted by their first 8 bytes, which only
+         * reads the beginning of each slot, and only slots that share those
+         * bytes are compared further.
+         */
+        std::pmr::vector<FileId> order(std::size_t slot_count) const;
+};
+
+#endif // PREFIX_ARENA_H
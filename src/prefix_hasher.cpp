@@ -0,0 +1,103 @@
+#include "prefix_hasher.h"
+
+#include <exception>
+#include <string>
+#include <utility>
+#include <vector>
+
+void PrefixHashes::set(FileId id, uint64_t hash)
+{
+    if (id >= hashes.size())
+    {
+        hashes.resize(id + 1);
+        known.resize(id + 1);
+    }
+    hashes[id] = hash;
+    known[id] = true;
+}
+
+uint64_t PrefixHashes::get(FileId id, const FileCatalog &files,
+                           uintmax_t bytes, FileReader &reader,
+                           std::string &path) const
+{
+    if (contains(id))
+    {
+        return hashes[id];
+    }
+    return reader.hash(files.path(id, path), bytes);
+}
+
+PrefixHasher::PrefixHasher(uintmax_t b, std::size_t buffer_size)
+    : bytes(b), reader(buffer_size), done(false)
+{
+    thread = std::thread(&PrefixHasher::run, this);
+}
+
+PrefixHasher::~PrefixHasher()
+{
+    if (thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done = true;
+            jobs.clear();
+        }
+        jobs_cv.notify_one();
+        thread.join();
+    }
+}
+
+void PrefixHasher::push(FileId id, std::string path)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        space_cv.wait(lock, [this]{return jobs.size() < max_jobs;});
+        jobs.emplace_back(id, std::move(path));
+    }
+    jobs_cv.notify_one();
+}
+
+void PrefixHasher::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        jobs_cv.wait(lock, [this]{return done || !jobs.empty();});
+        if (jobs.empty())
+        {
+            return;
+        }
+        const auto job = std::move(jobs.front());
+        jobs.pop_front();
+        lock.unlock();
+        space_cv.notify_one();
+
+        try
+        {
+            const uint64_t hash = reader.hash(job.second, bytes);
+            results.emplace_back(job.first, hash);
+        }
+        catch(const std::exception &)
+        {
+            // Hashed and reported again in the deduplication
+        }
+
+        lock.lock();
+    }
+}
+
+void PrefixHasher::finish(PrefixHashes &hashes)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+    }
+    jobs_cv.notify_one();
+    thread.join();
+
+    for (const auto &result : results)
+    {
+        hashes.set(result.first, result.second);
+    }
+    results = std::vector<std::pair<FileId, uint64_t>>();
+}
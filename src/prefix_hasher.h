@@ -0,0 +1,87 @@
+#ifndef PREFIX_HASHER_H
+#define PREFIX_HASHER_H
+
+#include "file_catalog.h"
+#include "file_reader.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * Hashes of file beginnings that were calculated before the deduplication.
+ */
+class PrefixHashes {
+        std::vector<uint64_t> hashes;
+        std::vector<bool> known;
+
+    public:
+        void set(FileId id, uint64_t hash);
+
+        /**
+         * Returns true if the hash of the given file is known.
+         */
+        bool contains(FileId id) const
+        {
+            return id < known.size() && known[id];
+        }
+
+        /**
+         * Returns the hash of the given number of bytes from the beginning of
+         * the given file. If the hash is not known, it is calculated with the
+         * given reader, and the full path of the file is put together in the
+         * given string.
+         */
+        uint64_t get(FileId id, const FileCatalog &files, uintmax_t bytes,
+                     FileReader &reader, std::string &path) const;
+};
+
+/**
+ * Hashes the beginnings of files in a background thread while the paths are
+ * still being scanned. Files that can't be read are skipped, so that the
+ * error is reported when the file is hashed again during the deduplication.
+ * The queue of files holds at most max_jobs paths, so a scan that finds
+ * files faster than they are hashed waits instead of piling up paths.
+ */
+class PrefixHasher {
+        static constexpr std::size_t max_jobs = 4096;
+
+        const uintmax_t bytes;
+        FileReader reader;
+        std::mutex mutex;
+        std::condition_variable jobs_cv;
+        std::condition_variable space_cv;
+        std::deque<std::pair<FileId, std::string>> jobs;
+        bool done;
+        std::vector<std::pair<FileId, uint64_t>> results;
+        std::thread thread;
+
+        void run();
+
+    public:
+        /**
+         * The files are read with buffers of the given size.
+         */
+        PrefixHasher(uintmax_t b, std::size_t buffer_size);
+        ~PrefixHasher();
+        PrefixHasher(const PrefixHasher &) = delete;
+        PrefixHasher &operator=(const PrefixHasher &) = delete;
+
+        /**
+         * Queues the given file, whose full path is also given, for hashing.
+         * Waits while the queue is full.
+         */
+        void push(FileId id, std::string path);
+
+        /**
+         * Waits until all queued files have been hashed and stores the hashes.
+         */
+        void finish(PrefixHashes &hashes);
+};
+
+#endif // PREFIX_HASHER_H
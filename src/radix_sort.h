@@ -0,0 +1,279 @@
+#ifndef RADIX_SORT_H
+#define RADIX_SORT_H
+
+#include "file_catalog.h"
+#include "utilities.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * Returns the digit of the given key at the given position, 0 being the least
+ * significant digit, when digits are the given number of bits wide.
+ */
+inline unsigned key_digit(uint64_t key, unsigned position, unsigned bits)
+{
+    return static_cast<unsigned>(key >> (bits * position))
+        & ((1u << bits) - 1);
+}
+
+inline unsigned key_digit(const Digest128 &key, unsigned position,
+                          unsigned bits)
+{
+    const unsigned low_digits = 64 / bits;
+    return position < low_digits
+        ? key_digit(key.low, position, bits)
+        : key_digit(key.high, position - low_digits, bits);
+}
+
+/**
+ * Sets the bits of the given changes where the given key differs from the
+ * given first key.
+ */
+template <typename T>
+void add_key_changes(T &changes, T key, T first)
+{
+    changes = static_cast<T>(changes | (key ^ first));
+}
+
+inline void add_key_changes(Digest128 &changes, const Digest128 &key,
+                            const Digest128 &first)
+{
+    changes.low |= key.low ^ first.low;
+    changes.high |= key.high ^ first.high;
+}
+
+/**
+ * Sorts the given range stably with a merge sort that uses the given scratch
+ * range of the same length instead of allocating a buffer, as
+ * std::stable_sort would. Short runs are sorted by insertion first.
+ */
+template <typename Entry, typename Less>
+void merge_sort(Entry *first, Entry *last, Entry *scratch, Less less)
+{
+    constexpr std::ptrdiff_t run = 16;
+    const std::ptrdiff_t count = last - first;
+    for (Entry *begin = first; begin < last; begin += run)
+    {
+        Entry *const end = std::min(begin + run, last);
+        for (Entry *i = begin + 1; i < end; ++i)
+        {
+            Entry entry = std::move(*i);
+            Entry *j = i;
+            for (; j != begin && less(entry, *(j - 1)); --j)
+            {
+                *j = std::move(*(j - 1));
+            }
+            *j = std::move(entry);
+        }
+    }
+
+    Entry *from = first;
+    Entry *to = scratch;
+    for (std::ptrdiff_t width = run; width < count; width *= 2)
+    {
+        for (std::ptrdiff_t begin = 0; begin < count; begin += 2 * width)
+        {
+            const std::ptrdiff_t middle = std::min(begin + width, count);
+            const std::ptrdiff_t end = std::min(begin + 2 * width, count);
+            std::merge(std::make_move_iterator(from + begin),
+                       std::make_move_iterator(from + middle),
+                       std::make_move_iterator(from + middle),
+                       std::make_move_iterator(from + end),
+                       to + begin, less);
+        }
+        std::swap(from, to);
+    }
+    if (from != first)
+    {
+        std::move(from, from + count, first);
+    }
+}
+
+/**
+ * Sorts the given (key, id) pairs by their keys with a stable LSD radix sort,
+ * so that pairs with the same key keep their order. Keys are sorted a digit
+ * at a time, and digits that are the same in every key are skipped, so that
+ * narrow keys and keys that share their high bits take fewer passes. Large
+ * inputs are sorted by 16-bit digits, which halves the passes over the
+ * entries, and smaller ones by bytes, whose counts are cheaper to clear.
+ *
+ * Keys that vary in more digits than the passes are worth, such as 128-bit
+ * digests, are instead split by their most significant digit that varies,
+ * and the parts, which mostly fit in the cache, are sorted by comparison.
+ *
+ * Inputs that are large enough are split into a chunk for each of up to the
+ * given number of threads. Each pass counts the digits of every chunk in
+ * parallel, and then moves the chunks to their places in parallel, which
+ * keeps the sort stable. Small inputs are sorted by comparison instead.
+ *
+ * The buffer that the entries are moved to, and the counts of the passes,
+ * are allocated with the allocator of the entries, such as that of the
+ * arena of a size group.
+ */
+template <typename T, typename Allocator>
+void radix_sort(std::vector<std::pair<T, FileId>, Allocator> &entries,
+                unsigned threads)
+{
+    using Entry = std::pair<T, FileId>;
+    using Traits = std::allocator_traits<Allocator>;
+    using KeyVector = std::vector<T,
+        typename Traits::template rebind_alloc<T>>;
+    using PositionVector = std::vector<unsigned,
+        typename Traits::template rebind_alloc<unsigned>>;
+    using IndexVector = std::vector<FileId,
+        typename Traits::template rebind_alloc<FileId>>;
+    // Below this, the passes cost more than comparisons
+    constexpr std::size_t min_radix = 512;
+    // Entries that make 16-bit digits worth their counts
+    constexpr std::size_t min_wide = 1 << 17;
+    // Entries that make a thread worth starting
+    constexpr std::size_t min_chunk = 1 << 18;
+    // Passes over the entries that beat sorting them by comparison
+    constexpr std::size_t max_passes = 4;
+    const auto by_key = [](const Entry &a, const Entry &b)
+    {
+        return a.first < b.first;
+    };
+
+    const std::size_t count = entries.size();
+    if (count < min_radix)
+    {
+        std::vector<Entry, Allocator> scratch(count,
+                                              entries.get_allocator());
+        merge_sort(entries.data(), entries.data() + count, scratch.data(),
+                   by_key);
+        return;
+    }
+
+    const unsigned bits = sizeof(T) > 1 && count >= min_wide ? 16 : 8;
+    const std::size_t radix = std::size_t(1) << bits;
+    const unsigned digits = 8 * sizeof(T) / bits;
+    const std::size_t chunk_count = std::max<std::size_t>(1,
+        std::min<std::size_t>(threads, count / min_chunk));
+    const std::size_t chunk_length = (count + chunk_count - 1) / chunk_count;
+    const auto in_parallel = [chunk_count](auto function)
+    {
+        std::vector<std::thread> workers;
+        for (std::size_t chunk = 1; chunk < chunk_count; ++chunk)
+        {
+            workers.emplace_back(function, chunk);
+        }
+        function(0);
+        for (auto &worker : workers)
+        {
+            worker.join();
+        }
+    };
+    const auto chunk_begin = [count, chunk_length](std::size_t chunk)
+    {
+        return std::min(count, chunk * chunk_length);
+    };
+
+    // The bits that differ between keys tell which digits need a pass
+    KeyVector chunk_changes(chunk_count, T{}, entries.get_allocator());
+    in_parallel([&](std::size_t chunk)
+    {
+        T changes{};
+        for (std::size_t i = chunk_begin(chunk); i < chunk_begin(chunk + 1);
+             ++i)
+        {
+            add_key_changes(changes, entries[i].first, entries[0].first);
+        }
+        chunk_changes[chunk] = changes;
+    });
+    T changes{};
+    for (const T &chunk_change : chunk_changes)
+    {
+        add_key_changes(changes, chunk_change, T{});
+    }
+    PositionVector positions(entries.get_allocator());
+    for (unsigned position = 0; position < digits; ++position)
+    {
+        if (key_digit(changes, position, bits) != 0)
+        {
+            positions.push_back(position);
+        }
+    }
+
+    std::vector<Entry, Allocator> buffer(count, entries.get_allocator());
+    Entry *from = entries.data();
+    Entry *to = buffer.data();
+    // Entries can't outnumber the ids, so their indices fit in ids. First
+    // the number of entries of each chunk with each digit, and then the
+    // index in "to" where the next one goes.
+    IndexVector next(chunk_count * radix, 0, entries.get_allocator());
+    // Index in "to" where the entries with each digit start
+    IndexVector starts(radix + 1, 0, entries.get_allocator());
+    const auto scatter = [&](unsigned position)
+    {
+        in_parallel([&](std::size_t chunk)
+        {
+            FileId *counts = next.data() + chunk * radix;
+            std::fill(counts, counts + radix, 0);
+            for (std::size_t i = chunk_begin(chunk);
+                 i < chunk_begin(chunk + 1); ++i)
+            {
+                ++counts[key_digit(from[i].first, position, bits)];
+            }
+        });
+        FileId index = 0;
+        for (std::size_t value = 0; value < radix; ++value)
+        {
+            starts[value] = index;
+            for (std::size_t chunk = 0; chunk < chunk_count; ++chunk)
+            {
+                const FileId chunk_count_of = next[chunk * radix + value];
+                next[chunk * radix + value] = index;
+                index += chunk_count_of;
+            }
+        }
+        starts[radix] = index;
+        in_parallel([&](std::size_t chunk)
+        {
+            FileId *indices = next.data() + chunk * radix;
+            for (std::size_t i = chunk_begin(chunk);
+                 i < chunk_begin(chunk + 1); ++i)
+            {
+                to[indices[key_digit(from[i].first, position, bits)]++]
+                    = from[i];
+            }
+        });
+        std::swap(from, to);
+    };
+
+    if (positions.size() > max_passes)
+    {
+        scatter(positions.back());
+        in_parallel([&](std::size_t chunk)
+        {
+            for (std::size_t value = radix * chunk / chunk_count;
+                 value < radix * (chunk + 1) / chunk_count; ++value)
+            {
+                // The same part of the other array is free
+                merge_sort(from + starts[value], from + starts[value + 1],
+                           to + starts[value], by_key);
+            }
+        });
+    }
+    else
+    {
+        for (const unsigned position : positions)
+        {
+            scatter(position);
+        }
+    }
+
+    if (from != entries.data())
+    {
+        entries.swap(buffer);
+    }
+}
+
+#endif // RADIX_SORT_H
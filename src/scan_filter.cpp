@@ -0,0 +1,162 @@
+#include "scan_filter.h"
+
+#include <string>
+
+using std::size_t;
+
+Glob::Glob(const std::string &pattern)
+{
+    for (size_t i = 0; i < pattern.size(); ++i)
+    {
+        const char c = pattern[i];
+        if (c == '*')
+        {
+            // Consecutive stars match the same as one
+            if (tokens.empty() || tokens.back().kind != Token::Kind::star)
+            {
+                tokens.push_back(Token{Token::Kind::star, 0, 0});
+            }
+        }
+        else if (c == '?')
+        {
+            tokens.push_back(Token{Token::Kind::any, 0, 0});
+        }
+        else if (c == '\\' && i + 1 < pattern.size())
+        {
+            tokens.push_back(Token{Token::Kind::literal, pattern[++i], 0});
+        }
+        else if (c == '[')
+        {
+            // Find the end of the bracket expression. A ']' right after the
+            // opening bracket or the negation is a member of the set.
+            size_t end = i + 1;
+            if (end < pattern.size()
+                && (pattern[end] == '!' || pattern[end] == '^'))
+            {
+                ++end;
+            }
+            if (end < pattern.size() && pattern[end] == ']')
+            {
+                ++end;
+            }
+            while (end < pattern.size() && pattern[end] != ']')
+            {
+                ++end;
+            }
+            if (end == pattern.size())
+            {
+                // Without a closing bracket, '[' is an ordinary character
+                tokens.push_back(Token{Token::Kind::literal, c, 0});
+                continue;
+            }
+
+            std::bitset<256> set;
+            size_t j = i + 1;
+            const bool negated = pattern[j] == '!' || pattern[j] == '^';
+            if (negated)
+            {
+                ++j;
+            }
+            for (; j < end; ++j)
+            {
+                const auto first = static_cast<unsigned char>(pattern[j]);
+                if (j + 2 < end && pattern[j + 1] == '-')
+                {
+                    const auto last = 
+                        static_cast<unsigned char>(pattern[j + 2]);
+                    for (unsigned member = first; member <= last; ++member)
+                    {
+                        set.set(member);
+                    }
+                    j += 2;
+                }
+                else
+                {
+                    set.set(first);
+                }
+            }
+            if (negated)
+            {
+                set.flip();
+            }
+            sets.push_back(set);
+            tokens.push_back(Token{Token::Kind::set, 0, sets.size() - 1});
+            i = end;
+        }
+        else
+        {
+            tokens.push_back(Token{Token::Kind::literal, c, 0});
+        }
+    }
+}
+
+bool Glob::matches(const char *name) const
+{
+    // After a mismatch, backtrack to the latest star and let it match one more
+    // character. Earlier stars never need to be revisited.
+    size_t token = 0;
+    const char *c = name;
+    size_t star_token = tokens.size();
+    const char *star_c = nullptr;
+    while (*c != '\0')
+    {
+        if (token < tokens.size())
+        {
+            const Token &t = tokens[token];
+            if (t.kind == Token::Kind::star)
+            {
+                star_token = ++token;
+                star_c = c;
+                continue;
+            }
+            if (t.kind == Token::Kind::any
+                || (t.kind == Token::Kind::literal && t.literal == *c)
+                || (t.kind == Token::Kind::set
+                    && sets[t.set].test(static_cast<unsigned char>(*c))))
+            {
+                ++token;
+                ++c;
+                continue;
+            }
+        }
+        if (star_c == nullptr)
+        {
+            return false;
+        }
+        token = star_token;
+        c = ++star_c;
+    }
+    while (token < tokens.size() && tokens[token].kind == Token::Kind::star)
+    {
+        ++token;
+    }
+    return token == tokens.size();
+}
+
+bool ScanFilter::excludes(const char *name) const
+{
+    for (const auto &glob : exclude)
+    {
+        if (glob.matches(name))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ScanFilter::includes(const char *name) const
+{
+    if (include.empty())
+    {
+        return true;
+    }
+    for (const auto &glob : include)
+    {
+        if (glob.matches(name))
+        {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,73 @@
+#ifndef SCAN_FILTER_H
+#define SCAN_FILTER_H
+
+#include "size_sketch.h"
+
+#include <bitset>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * A shell-style wildcard pattern that is matched against file names.
+ * Supports '*', '?', bracket expressions such as "[a-z]" and "[!0-9]", and
+ * escaping with '\'. The pattern is compiled once, and matching doesn't
+ * allocate.
+ */
+class Glob {
+        struct Token {
+            enum class Kind {literal, any, star, set} kind;
+            char literal;
+            std::size_t set; // Index to sets
+        };
+
+        std::vector<Token> tokens;
+        std::vector<std::bitset<256>> sets;
+
+    public:
+        explicit Glob(const std::string &pattern);
+
+        /**
+         * Returns true if the whole given name matches the pattern.
+         */
+        bool matches(const char *name) const;
+};
+
+/**
+ * Rules for skipping entries while the paths are scanned.
+ */
+struct ScanFilter {
+    // Files smaller than this are skipped
+    uintmax_t min_size = 0;
+    // Files larger than this are skipped. 0 means no limit.
+    uintmax_t max_size = 0;
+    // If not empty, only files whose name matches a pattern are scanned
+    std::vector<Glob> include;
+    // Files and directories whose name matches a pattern are skipped
+    std::vector<Glob> exclude;
+    // If not null, files whose size was seen only once are skipped
+    const SizeSketch *sizes = nullptr;
+
+    /**
+     * Returns true if a file or directory with the given name is skipped.
+     * The contents of skipped directories are not scanned.
+     */
+    bool excludes(const char *name) const;
+
+    /**
+     * Returns true if a file with the given name is scanned, unless it is
+     * excluded.
+     */
+    bool includes(const char *name) const;
+
+    /**
+     * Returns true if a file of the given size is scanned.
+     */
+    bool accepts_size(uintmax_t size) const
+    {
+        return size >= min_size && (max_size == 0 || size <= max_size)
+            && (sizes == nullptr || sizes->repeated(size));
+    }
+};
+
+#endif // SCAN_FILTER_H
@@ -0,0 +1,86 @@
+#include "scratch_file.h"
+
+#include <cerrno>
+#include <filesystem>
+#include <system_error>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using std::size_t;
+
+namespace fs = std::filesystem;
+
+namespace {
+[[noreturn]] void throw_errno(const char *what)
+{
+    throw std::system_error(errno, std::system_category(), what);
+}
+}
+
+ScratchFile::ScratchFile()
+{
+#ifdef __linux__
+    // Unlike tmpfile, follows TMPDIR, so that scratch space can be put on
+    // another disk
+    const int fd = open(fs::temp_directory_path().c_str(),
+                        O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd == -1)
+    {
+        throw_errno("Can't create a temporary file");
+    }
+    file = fdopen(fd, "w+b");
+    if (file == nullptr)
+    {
+        const int error = errno;
+        close(fd);
+        errno = error;
+    }
+#else
+    file = std::tmpfile();
+#endif
+    if (file == nullptr)
+    {
+        throw_errno("Can't create a temporary file");
+    }
+}
+
+ScratchFile::~ScratchFile()
+{
+    std::fclose(file);
+}
+
+void ScratchFile::write(const void *data, size_t length)
+{
+    if (std::fwrite(data, 1, length, file) != length)
+    {
+        throw_errno("Can't write a temporary file");
+    }
+}
+
+void ScratchFile::rewind()
+{
+    if (std::fflush(file) != 0 || std::fseek(file, 0, SEEK_SET) != 0)
+    {
+        throw_errno("Can't rewind a temporary file");
+    }
+}
+
+size_t ScratchFile::read(void *data, size_t length)
+{
+    const size_t count = std::fread(data, 1, length, file);
+    if (count < length && std::ferror(file))
+    {
+        throw_errno("Can't read a temporary file");
+    }
+    return count;
+}
+
+#ifdef __linux__
+int ScratchFile::descriptor() const
+{
+    return fileno(file);
+}
+#endif
@@ -0,0 +1,43 @@
+#ifndef SCRATCH_FILE_H
+#define SCRATCH_FILE_H
+
+#include <cstddef>
+#include <cstdio>
+
+/**
+ * A temporary file without a name in the system's temporary directory, which
+ * can be set with the environment variable TMPDIR. The file is removed when
+ * it is closed. Throws std::system_error if the file can't be created,
+ * written or read.
+ */
+class ScratchFile {
+        std::FILE *file;
+
+    public:
+        ScratchFile();
+        ~ScratchFile();
+        ScratchFile(const ScratchFile &) = delete;
+        ScratchFile &operator=(const ScratchFile &) = delete;
+
+        /**
+         * Appends the given bytes to the file.
+         */
+        void write(const void *data, std::size_t length);
+
+        /**
+         * Moves to the beginning of the file for reading it.
+         */
+        void rewind();
+
+        /**
+         * Reads at most the given number of bytes. Returns the number of
+         * bytes read, which is less than asked only at the end of the file.
+         */
+        std::size_t read(void *data, std::size_t length);
+
+#ifdef __linux__
+        int descriptor() const;
+#endif
+};
+
+#endif // SCRATCH_FILE_H
@@ -0,0 +1,81 @@
+#include "size_sketch.h"
+
+using std::size_t;
+
+SizeSketch::SizeSketch() : count(0)
+{
+    allocate(0);
+}
+
+size_t SizeSketch::find(uint64_t size) const
+{
+    // Fibonacci hashing spreads sizes that are multiples of large powers of
+    // two, such as the sizes of blocks and images
+    size_t index = static_cast<size_t>(
+        (size * 0x9e3779b97f4a7c15ull) >> shift);
+    while (slots[index] != 0 && (slots[index] & ~repeated_bit) != size)
+    {
+        index = (index + 1) & mask;
+    }
+    return index;
+}
+
+void SizeSketch::allocate(size_t size_count)
+{
+    size_t slot_count = 16;
+    shift = 60;
+    // The table is kept at most 3/4 full
+    while (slot_count * 3 < size_count * 4)
+    {
+        slot_count *= 2;
+        --shift;
+    }
+    slots.assign(slot_count, 0);
+    mask = slot_count - 1;
+}
+
+void SizeSketch::rebuild(size_t size_count, bool repeated_only)
+{
+    std::vector<uint64_t> old_slots;
+    old_slots.swap(slots);
+    allocate(size_count);
+    for (const uint64_t slot : old_slots)
+    {
+        if (slot != 0 && (!repeated_only || (slot & repeated_bit) != 0))
+        {
+            slots[find(slot & ~repeated_bit)] = slot;
+        }
+    }
+}
+
+void SizeSketch::add(uintmax_t size)
+{
+    uint64_t &slot = slots[find(size)];
+    if (slot != 0)
+    {
+        slot |= repeated_bit;
+        return;
+    }
+    slot = size;
+    ++count;
+    if (count * 4 > slots.size() * 3)
+    {
+        rebuild(count + 1, false);
+    }
+}
+
+size_t SizeSketch::drop_unique()
+{
+    size_t repeated_count = 0;
+    for (const uint64_t slot : slots)
+    {
+        if ((slot & repeated_bit) != 0)
+        {
+            ++repeated_count;
+        }
+    }
+    const size_t unique_count = count - repeated_count;
+    count = repeated_count;
+    rebuild(count, true);
+    return unique_count;
+}
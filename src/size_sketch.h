@@ -0,0 +1,59 @@
+#ifndef SIZE_SKETCH_H
+#define SIZE_SKETCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Records which file sizes have been seen, and which of them more than once,
+ * without storing anything else about the files. Used by the first pass of
+ * the low-memory scan, so that the second pass can skip the files whose size
+ * is unique before their paths and metadata are stored.
+ *
+ * The sizes are stored in one flat array of 8-byte slots with linear
+ * probing. The highest bit of a slot marks a size that was seen again, and
+ * 0 marks an empty slot, because empty files are never scanned.
+ */
+class SizeSketch {
+        std::vector<uint64_t> slots;
+        std::size_t mask;
+        // 64 minus the base-2 logarithm of the number of slots
+        unsigned shift;
+        std::size_t count;
+
+        std::size_t find(uint64_t size) const;
+        void allocate(std::size_t size_count);
+        void rebuild(std::size_t size_count, bool repeated_only);
+
+    public:
+        SizeSketch();
+
+        /**
+         * Records a file of the given size, which must not be 0.
+         */
+        void add(uintmax_t size);
+
+        /**
+         * Returns true if files of the given size were added at least twice.
+         */
+        bool repeated(uintmax_t size) const
+        {
+            return slots[find(size)] == (size | repeated_bit);
+        }
+
+        /**
+         * Returns the number of distinct sizes.
+         */
+        std::size_t size_count() const {return count;}
+
+        /**
+         * Forgets the sizes that were added only once, so that only the
+         * repeated sizes take memory. Returns the number of forgotten sizes.
+         */
+        std::size_t drop_unique();
+
+        static constexpr uint64_t repeated_bit = uint64_t(1) << 63;
+};
+
+#endif // SIZE_SKETCH_H
@@ -0,0 +1,953 @@
+#include "path_store.h"
+#include "traverse.h"
+#include "uring.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/magic.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <sys/sysmacros.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(__unix__)
+#include <sys/stat.h>
+#endif
+
+using std::cerr;
+using std::size_t;
+using std::string;
+using std::vector;
+
+namespace fs = std::filesystem;
+
+namespace {
+/**
+ * Number of files a worker collects before handing them to the sink.
+ */
+constexpr size_t batch_size = 1024;
+
+/**
+ * Device number of a directory that has not been opened yet.
+ */
+constexpr uintmax_t unknown_device = UINTMAX_MAX;
+
+#ifdef __linux__
+/**
+ * File descriptor of an enumerated directory. It is kept open while the
+ * subdirectories found in it wait in the queues, so that they can be opened
+ * relative to it instead of by their full paths.
+ */
+class DirectoryFd {
+        int fd;
+
+    public:
+        explicit DirectoryFd(int f) : fd(f) {};
+        ~DirectoryFd() {::close(fd);}
+        DirectoryFd(const DirectoryFd &) = delete;
+        DirectoryFd &operator=(const DirectoryFd &) = delete;
+
+        int get() const {return fd;}
+};
+#endif
+
+/**
+ * A directory waiting to be enumerated. The full path is kept only until the
+ * directory has been enumerated. Until then, the device is that of the parent 
+ * directory.
+ */
+struct Directory {
+    DirId id;
+    fs::path path;
+    size_t number_of_path;
+    uintmax_t device;
+    // Device of the given path that the directory was found in
+    uintmax_t root_device;
+#ifdef __linux__
+    // Directory that this one was found in, or null for the given paths
+    std::shared_ptr<const DirectoryFd> parent;
+#endif
+};
+
+/**
+ * Files collected by a worker before they are handed to the sink. Until then,
+ * the names of the files are stored here, and the name in the path of a file
+ * is an offset to names.
+ */
+struct FileBatch {
+    vector<ScannedFile> files;
+    string names;
+
+    FileBatch()
+    {
+        files.reserve(batch_size);
+    }
+
+    void add(ScannedFile file, const char *name)
+    {
+        file.path.name = names.size();
+        names += name;
+        names += '\0';
+        files.push_back(std::move(file));
+    }
+
+    size_t size() const {return files.size();}
+};
+
+#ifdef __linux__
+/**
+ * Size of the buffer that directory entries are read into.
+ */
+constexpr size_t dirent_buffer_size = 32 * 1024;
+
+/**
+ * The metadata of a directory entry that the scanning needs.
+ */
+struct EntryStatus {
+    mode_t mode;
+    uintmax_t size;
+    uintmax_t links;
+    uintmax_t device;
+    uintmax_t inode;
+    int64_t m_time_sec;
+    uint32_t m_time_nsec;
+};
+
+/**
+ * Flags and mask for statx. Only the fields the scanning needs are asked for,
+ * and automounts are not triggered.
+ */
+constexpr int statx_flags = AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT;
+constexpr unsigned statx_mask = 
+    STATX_TYPE | STATX_SIZE | STATX_NLINK | STATX_MTIME | STATX_INO;
+
+EntryStatus to_entry_status(const struct statx &stx)
+{
+    return EntryStatus{stx.stx_mode, stx.stx_size, stx.stx_nlink,
+                       makedev(stx.stx_dev_major, stx.stx_dev_minor),
+                       stx.stx_ino, stx.stx_mtime.tv_sec,
+                       stx.stx_mtime.tv_nsec};
+}
+
+/**
+ * Fetches the metadata of the given entry of the given directory with a single
+ * system call, without following symlinks. Falls back to fstatat on kernels
+ * without statx. Returns false and sets errno on failure.
+ */
+bool stat_entry(int dir_fd, const char *name, EntryStatus &status)
+{
+    static std::atomic<bool> has_statx(true);
+    if (has_statx)
+    {
+        struct statx stx;
+        if (::statx(dir_fd, name, statx_flags, statx_mask, &stx) == 0)
+        {
+            status = to_entry_status(stx);
+            return true;
+        }
+        if (errno != ENOSYS)
+        {
+            return false;
+        }
+        has_statx = false;
+    }
+
+    struct stat st;
+    if (::fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+    {
+        return false;
+    }
+    status = EntryStatus{st.st_mode, static_cast<uintmax_t>(st.st_size),
+                         st.st_nlink, st.st_dev, st.st_ino, st.st_mtim.tv_sec,
+                         static_cast<uint32_t>(st.st_mtim.tv_nsec)};
+    return true;
+}
+
+/**
+ * Returns true if the given file system type is a pseudo file system, whose
+ * files are generated by the kernel and can't have meaningful duplicates.
+ * Reading some of them can also block.
+ */
+bool is_pseudo_file_system(uint32_t type)
+{
+    switch (type)
+    {
+    case BINFMTFS_MAGIC:
+    case BPF_FS_MAGIC:
+    case CGROUP_SUPER_MAGIC:
+    case CGROUP2_SUPER_MAGIC:
+    case DEBUGFS_MAGIC:
+    case DEVPTS_SUPER_MAGIC:
+    case EFIVARFS_MAGIC:
+    case NSFS_MAGIC:
+    case PROC_SUPER_MAGIC:
+    case PSTOREFS_MAGIC:
+    case RDTGROUP_SUPER_MAGIC:
+    case SECURITYFS_MAGIC:
+    case SELINUX_MAGIC:
+    case SMACK_MAGIC:
+    case SYSFS_MAGIC:
+    case TRACEFS_MAGIC:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * Converts a time since the Unix epoch to the clock of std::filesystem. The
+ * epochs of the clocks differ by a whole number of seconds, so the difference
+ * is found exactly by rounding the difference of their current times.
+ */
+fs::file_time_type to_file_time(int64_t sec, uint32_t nsec)
+{
+    using namespace std::chrono;
+    static const auto epoch_difference = round<seconds>(
+        fs::file_time_type::clock::now().time_since_epoch()
+        - system_clock::now().time_since_epoch());
+
+    return fs::file_time_type(duration_cast<fs::file_time_type::duration>(
+        seconds(sec) + nanoseconds(nsec) + epoch_difference));
+}
+
+/**
+ * Adds the given entry of the given directory to the batch, if it is a regular
+ * non-empty file whose size the filter accepts.
+ */
+void collect_file(DirId dir, const char *name, const EntryStatus &status,
+                  size_t number_of_path, const ScanFilter &filter,
+                  FileBatch &batch)
+{
+    // Symlinks and empty files are skipped
+    if (S_ISREG(status.mode) && status.size > 0 
+        && filter.accepts_size(status.size))
+    {
+        batch.add(ScannedFile{PathHandle{dir, 0},
+                              status.size,
+                              to_file_time(status.m_time_sec,
+                                           status.m_time_nsec),
+                              status.device,
+                              status.inode,
+                              status.links > 1,
+                              number_of_path},
+                  name);
+    }
+}
+
+/**
+ * Prints the error in errno, related to the given path.
+ */
+void print_error(const string &path)
+{
+    cerr << std::system_category().message(errno) << " [" << path << "]\n";
+}
+
+/**
+ * Adds the file in the given path to the batch, if it is a regular non-empty
+ * file whose size the filter accepts. The file is in the given directory.
+ */
+void collect_file(const fs::path &path, DirId dir, size_t number_of_path,
+                  const ScanFilter &filter, FileBatch &batch)
+{
+    EntryStatus status;
+    if (stat_entry(AT_FDCWD, path.c_str(), status))
+    {
+        collect_file(dir, path.filename().c_str(), status, number_of_path, 
+                     filter, batch);
+    }
+    else
+    {
+        print_error(path.string());
+    }
+}
+#else
+/**
+ * Returns the device and inode numbers of the file in the given path, or 
+ * zeros if they are not available.
+ */
+std::pair<uintmax_t, uintmax_t> file_identity(const fs::path &path)
+{
+#if defined(__unix__)
+    struct stat s;
+    if (::lstat(path.c_str(), &s) == 0)
+    {
+        return {s.st_dev, s.st_ino};
+    }
+#endif
+    (void)path;
+    return {0, 0};
+}
+
+/**
+ * Adds the file in the given directory entry to the batch, if it is a regular
+ * non-empty file whose size the filter accepts. The file is in the given 
+ * directory.
+ */
+void collect_file(const fs::directory_entry &entry, DirId dir,
+                  size_t number_of_path, const ScanFilter &filter,
+                  FileBatch &batch)
+{
+    try
+    {
+        const fs::path &path = entry.path();
+        // Symlinks and empty files are skipped
+        if (fs::is_regular_file(fs::symlink_status(path))
+            && !fs::is_empty(path) && filter.accepts_size(entry.file_size()))
+        {
+            const auto identity = file_identity(path);
+            batch.add(ScannedFile{PathHandle{dir, 0},
+                                  entry.file_size(),
+                                  entry.last_write_time(),
+                                  identity.first,
+                                  identity.second,
+                                  fs::hard_link_count(path) > 1,
+                                  number_of_path},
+                      path.filename().string().c_str());
+        }
+    }
+    catch(const fs::filesystem_error &e)
+    {
+        cerr << e.what() << '\n';
+    }
+    catch(const std::runtime_error &e)
+    {
+        cerr << e.what() << " [" << entry.path().string() << "]\n";
+    }
+    catch(const std::exception& e)
+    {
+        cerr << e.what() << '\n';
+    }
+}
+
+/**
+ * Adds the file in the given path to the batch, if it is a regular non-empty
+ * file whose size the filter accepts. The file is in the given directory.
+ */
+void collect_file(const fs::path &path, DirId dir, size_t number_of_path,
+                  const ScanFilter &filter, FileBatch &batch)
+{
+    collect_file(fs::directory_entry(path), dir, number_of_path, filter, 
+                 batch);
+}
+#endif
+
+/**
+ * Double-ended queue of directories owned by one worker. The owner pushes and
+ * pops at the back, so it proceeds depth first. Idle workers steal from the
+ * front, where the directories closest to the root (and therefore likely the
+ * largest subtrees) are.
+ */
+class WorkQueue {
+        std::mutex mutex;
+        std::deque<Directory> directories;
+
+    public:
+        void push(Directory directory)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            directories.push_back(std::move(directory));
+        }
+
+        bool pop(Directory &directory)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (directories.empty())
+            {
+                return false;
+            }
+            directory = std::move(directories.back());
+            directories.pop_back();
+            return true;
+        }
+
+        bool steal(Directory &directory)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (directories.empty())
+            {
+                return false;
+            }
+            directory = std::move(directories.front());
+            directories.pop_front();
+            return true;
+        }
+};
+
+/**
+ * State of one worker thread.
+ */
+struct Worker {
+    size_t index;
+    FileBatch batch;
+#ifdef __linux__
+    vector<char> dirents;
+    // Used for fetching metadata in batches, if available
+    std::unique_ptr<IoUring> ring;
+    // Names of the directory entries whose metadata is to be fetched
+    vector<const char *> names;
+    vector<struct statx> statxs;
+#endif
+
+    explicit Worker(size_t i) : index(i) {};
+};
+
+/**
+ * Shared state of the worker threads.
+ */
+class Traversal {
+        const TraversalOptions &options;
+        const ScanSink &sink;
+        // Guards both the path store and the sink
+        std::mutex store_mutex;
+        PathStore &store;
+        vector<WorkQueue> queues;
+        // Directories that are queued or being enumerated. The traversal is
+        // done when this reaches zero.
+        std::atomic<size_t> pending;
+        // Directories that are queued
+        std::atomic<size_t> queued;
+        std::mutex idle_mutex;
+        std::condition_variable idle_cv;
+
+    public:
+        Traversal(const TraversalOptions &o, PathStore &p, const ScanSink &s,
+                  size_t threads)
+            : options(o), sink(s), store(p), queues(threads), pending(0),
+              queued(0) {};
+
+        DirId add_root(const string &path)
+        {
+            std::lock_guard<std::mutex> lock(store_mutex);
+            return store.add_root(path);
+        }
+
+#ifdef __linux__
+        /**
+         * Adds a subdirectory of the given directory, which is open with the
+         * given descriptor, to the store and to the queue of the given
+         * worker.
+         */
+        void add_subdirectory(const Directory &parent,
+                              const std::shared_ptr<const DirectoryFd> &fd,
+                              const char *name, size_t worker)
+        {
+            Directory directory = subdirectory(parent, name);
+            directory.parent = fd;
+            add_directory(std::move(directory), worker);
+        }
+#else
+        /**
+         * Adds a subdirectory of the given directory to the store and to the
+         * queue of the given worker.
+         */
+        void add_subdirectory(const Directory &parent, const char *name,
+                              size_t worker)
+        {
+            add_directory(subdirectory(parent, name), worker);
+        }
+#endif
+
+        void add_directory(Directory directory, size_t worker)
+        {
+            ++pending;
+            queues[worker].push(std::move(directory));
+            ++queued;
+            std::lock_guard<std::mutex> lock(idle_mutex);
+            idle_cv.notify_one();
+        }
+
+        /**
+         * Moves the names of the files in the batch to the store, unless
+         * they are not stored, and hands the files to the sink.
+         */
+        void flush(FileBatch &batch)
+        {
+            if (batch.files.empty())
+            {
+                return;
+            }
+            std::lock_guard<std::mutex> lock(store_mutex);
+            for (auto &file : batch.files)
+            {
+                if (options.store_names)
+                {
+                    file.path = store.add_file(file.path.dir, 
+                        batch.names.data() + file.path.name);
+                }
+            }
+            sink(batch.files);
+            batch.files.clear();
+            batch.names.clear();
+        }
+
+        /**
+         * Enumerates directories until there are none left.
+         */
+        void run(size_t index)
+        {
+            Worker worker(index);
+#ifdef __linux__
+            worker.dirents.resize(dirent_buffer_size);
+            if (options.queue_depth > 0)
+            {
+                try
+                {
+                    worker.ring = std::make_unique<IoUring>(
+                        options.queue_depth, 
+                        std::initializer_list<int>{IORING_OP_STATX});
+                    worker.statxs.resize(worker.ring->get_entries());
+                }
+                catch(const std::system_error &e)
+                {
+                    static std::once_flag reported;
+                    std::call_once(reported, [&e]{
+                        cerr << "io_uring is not available (" << e.what()
+                             << "), fetching metadata synchronously\n";
+                    });
+                }
+            }
+#endif
+            Directory directory;
+            while (next(worker.index, directory))
+            {
+                enumerate(directory, worker);
+                if (--pending == 0)
+                {
+                    std::lock_guard<std::mutex> lock(idle_mutex);
+                    idle_cv.notify_all();
+                }
+            }
+            flush(worker.batch);
+        }
+
+    private:
+        /**
+         * Adds a subdirectory of the given directory to the store, and
+         * returns it.
+         */
+        Directory subdirectory(const Directory &parent, const char *name)
+        {
+            DirId id;
+            {
+                std::lock_guard<std::mutex> lock(store_mutex);
+                id = store.add_directory(parent.id, name);
+            }
+            Directory directory;
+            directory.id = id;
+            directory.path = parent.path / name;
+            directory.number_of_path = parent.number_of_path;
+            directory.device = parent.device;
+            directory.root_device = parent.root_device;
+            return directory;
+        }
+
+        /**
+         * Takes a directory from the worker's own queue, or steals one from
+         * another worker. Waits if there is nothing to take but other workers
+         * may still find more directories. Returns false when the traversal
+         * is done.
+         */
+        bool next(size_t worker, Directory &directory)
+        {
+            while (true)
+            {
+                for (size_t i = 0; i < queues.size(); ++i)
+                {
+                    WorkQueue &queue = queues[(worker + i) % queues.size()];
+                    if (i == 0 ? queue.pop(directory) : queue.steal(directory))
+                    {
+                        --queued;
+                        return true;
+                    }
+                }
+
+                std::unique_lock<std::mutex> lock(idle_mutex);
+                if (pending == 0)
+                {
+                    return false;
+                }
+                idle_cv.wait(lock, [this]{ return queued > 0 || pending == 0; });
+            }
+        }
+
+#ifdef __linux__
+        /**
+         * Finds out the device of the directory, which is open with the given
+         * descriptor, and checks if the directory is to be enumerated.
+         * Directories on pseudo file systems are skipped, and so are
+         * directories on other devices than the given path, if so asked.
+         * The device of a given path is that of the directory that a symlink
+         * points to.
+         */
+        bool enter(Directory &directory, int dir_fd)
+        {
+            struct stat status;
+            if (::fstat(dir_fd, &status) != 0)
+            {
+                print_error(directory.path.string());
+                return false;
+            }
+            const uintmax_t device = status.st_dev;
+            if (directory.root_device == unknown_device)
+            {
+                directory.root_device = device;
+            }
+            else if (options.one_file_system 
+                     && device != directory.root_device)
+            {
+                return false;
+            }
+
+            // The type of the file system can only change at a mount point
+            if (device != directory.device)
+            {
+                struct statfs fs_status;
+                if (::fstatfs(dir_fd, &fs_status) == 0
+                    && is_pseudo_file_system(
+                        static_cast<uint32_t>(fs_status.f_type)))
+                {
+                    return false;
+                }
+            }
+            directory.device = device;
+            return true;
+        }
+
+        /**
+         * Opens the directory relative to the directory that it was found in,
+         * without following symlinks, so that its path is not resolved again
+         * and a directory above it that is renamed meanwhile doesn't matter.
+         * The given paths are opened following symlinks. The directory is
+         * skipped if it is not to be entered.
+         *
+         * Reads the entries of the directory with getdents64 and fetches the
+         * metadata of each entry relative to the directory's file descriptor.
+         * The type in the directory entry is used to skip symlinks and other
+         * special files without fetching their metadata. Names are filtered
+         * before the metadata is fetched too. If the worker has an io_uring
+         * instance, the metadata of the entries is fetched in batches.
+         */
+        void enumerate(Directory &directory, Worker &worker)
+        {
+            const string &dir_path = directory.path.native();
+            const int dir_fd = directory.parent
+                ? ::openat(directory.parent->get(),
+                           directory.path.filename().c_str(),
+                           O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)
+                : ::open(dir_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (dir_fd < 0)
+            {
+                // Directories that cannot be accessed are skipped
+                if (errno != EACCES && errno != EPERM)
+                {
+                    print_error(dir_path);
+                }
+                return;
+            }
+            // Closed when the subdirectories have been opened
+            const auto fd = std::make_shared<const DirectoryFd>(dir_fd);
+            if (!enter(directory, dir_fd))
+            {
+                return;
+            }
+
+            long count;
+            while ((count = ::syscall(SYS_getdents64, dir_fd, 
+                                      worker.dirents.data(),
+                                      worker.dirents.size())) > 0)
+            {
+                for (long offset = 0; offset < count;)
+                {
+                    // The layout of dirent64 is that of getdents64
+                    const auto *entry = reinterpret_cast<dirent64 *>(
+                        worker.dirents.data() + offset);
+                    offset += entry->d_reclen;
+
+                    const char *name = entry->d_name;
+                    if ((name[0] == '.' && (name[1] == '\0' 
+                        || (name[1] == '.' && name[2] == '\0')))
+                        || options.filter.excludes(name))
+                    {
+                        continue;
+                    }
+
+                    if (entry->d_type == DT_DIR)
+                    {
+                        if (options.recurse)
+                        {
+                            add_subdirectory(directory, fd, name, 
+                                             worker.index);
+                        }
+                        continue;
+                    }
+                    // Symlinks and special files are skipped. Some file
+                    // systems don't report the type, so it must be fetched.
+                    if (entry->d_type != DT_REG && entry->d_type != DT_UNKNOWN)
+                    {
+                        continue;
+                    }
+                    if (entry->d_type == DT_REG 
+                        && !options.filter.includes(name))
+                    {
+                        continue;
+                    }
+
+                    if (worker.ring)
+                    {
+                        worker.names.push_back(name);
+                        continue;
+                    }
+                    EntryStatus status;
+                    if (stat_entry(dir_fd, name, status))
+                    {
+                        add_entry(directory, fd, name, status, worker);
+                    }
+                    else
+                    {
+                        print_error((directory.path / name).string());
+                    }
+                }
+
+                // The names point to the buffer, so they must be handled 
+                // before reading more entries
+                if (worker.ring)
+                {
+                    stat_entries(fd, directory, worker);
+                }
+            }
+            if (count < 0)
+            {
+                print_error(dir_path);
+            }
+        }
+
+        /**
+         * Fetches the metadata of the entries in worker.names with io_uring.
+         * As many requests as fit in the submission queue are submitted at 
+         * once, so the kernel and the device can overlap them.
+         */
+        void stat_entries(const std::shared_ptr<const DirectoryFd> &fd,
+                          const Directory &directory, Worker &worker)
+        {
+            const int dir_fd = fd->get();
+            IoUring &ring = *worker.ring;
+            const size_t names_count = worker.names.size();
+            for (size_t first = 0; first < names_count;)
+            {
+                unsigned submitted = 0;
+                for (; first + submitted < names_count; ++submitted)
+                {
+                    io_uring_sqe *sqe = ring.get_sqe();
+                    if (sqe == nullptr)
+                    {
+                        break;
+                    }
+                    sqe->opcode = IORING_OP_STATX;
+                    sqe->fd = dir_fd;
+                    sqe->addr = reinterpret_cast<uintptr_t>(
+                        worker.names[first + submitted]);
+                    sqe->len = statx_mask;
+                    sqe->statx_flags = statx_flags;
+                    sqe->off = reinterpret_cast<uintptr_t>(
+                        &worker.statxs[submitted]);
+                    sqe->user_data = submitted;
+                }
+                ring.submit(submitted);
+
+                io_uring_cqe cqe;
+                for (unsigned completed = 0; completed < submitted;)
+                {
+                    if (!ring.next_cqe(cqe))
+                    {
+                        ring.submit(1);
+                        continue;
+                    }
+                    ++completed;
+                    const char *name = worker.names[first + cqe.user_data];
+                    if (cqe.res < 0)
+                    {
+                        errno = -cqe.res;
+                        print_error((directory.path / name).string());
+                        continue;
+                    }
+                    add_entry(directory, fd, name,
+                              to_entry_status(worker.statxs[cqe.user_data]),
+                              worker);
+                }
+                first += submitted;
+            }
+            worker.names.clear();
+        }
+
+        /**
+         * Handles an entry of the given directory, which is open with the
+         * given descriptor, whose metadata has been fetched.
+         */
+        void add_entry(const Directory &directory,
+                       const std::shared_ptr<const DirectoryFd> &fd,
+                       const char *name, const EntryStatus &status,
+                       Worker &worker)
+        {
+            if (S_ISDIR(status.mode))
+            {
+                if (options.recurse)
+                {
+                    add_subdirectory(directory, fd, name, worker.index);
+                }
+                return;
+            }
+            // Needed for entries whose type was not known from the directory
+            if (!options.filter.includes(name))
+            {
+                return;
+            }
+
+            collect_file(directory.id, name, status, directory.number_of_path,
+                         options.filter, worker.batch);
+            if (worker.batch.size() >= batch_size)
+            {
+                flush(worker.batch);
+            }
+        }
+#else
+        /**
+         * Checks if the directory is to be enumerated. Directories on other
+         * devices than the given path are skipped, if so asked and if the
+         * devices are known.
+         */
+        bool enter(Directory &directory)
+        {
+            if (!options.one_file_system)
+            {
+                return true;
+            }
+            directory.device = file_identity(directory.path).first;
+            if (directory.root_device == unknown_device)
+            {
+                directory.root_device = directory.device;
+            }
+            return directory.device == directory.root_device;
+        }
+
+        void enumerate(Directory &directory, Worker &worker)
+        {
+            if (!enter(directory))
+            {
+                return;
+            }
+            try
+            {
+                // Directories that cannot be accessed are skipped
+                for (const auto &entry : fs::directory_iterator(directory.path,
+                    fs::directory_options::skip_permission_denied))
+                {
+                    const string name = entry.path().filename().string();
+                    if (options.filter.excludes(name.c_str()))
+                    {
+                        continue;
+                    }
+                    // Symlinks to directories are not followed
+                    std::error_code ec;
+                    if (options.recurse 
+                        && fs::is_directory(entry.symlink_status(ec)))
+                    {
+                        add_subdirectory(directory, name.c_str(), 
+                                         worker.index);
+                    }
+                    else if (options.filter.includes(name.c_str()))
+                    {
+                        collect_file(entry, directory.id,
+                                     directory.number_of_path, options.filter,
+                                     worker.batch);
+                        if (worker.batch.size() >= batch_size)
+                        {
+                            flush(worker.batch);
+                        }
+                    }
+                }
+            }
+            catch(const std::exception &e)
+            {
+                cerr << e.what() << '\n';
+            }
+        }
+#endif
+};
+}
+
+/**
+ * Traverses the given paths and passes the found files to the sink. The index 
+ * of a path in the given vector is stored in the files found in it.
+ */
+void traverse_paths(const vector<fs::path> &paths, 
+                    const TraversalOptions &options, PathStore &store,
+                    const ScanSink &sink)
+{
+    size_t threads = options.threads;
+    if (threads == 0)
+    {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    Traversal traversal(options, store, sink, threads);
+
+    // Paths that are files are collected right away, directories are
+    // distributed to the workers
+    FileBatch batch;
+    for (size_t number_of_path = 0; number_of_path < paths.size();
+         ++number_of_path)
+    {
+        const fs::path &path = paths[number_of_path];
+        try
+        {
+            if (fs::is_directory(path))
+            {
+                Directory directory;
+                directory.id = traversal.add_root(path.string());
+                directory.path = path;
+                directory.number_of_path = number_of_path;
+                directory.device = unknown_device;
+                directory.root_device = unknown_device;
+                traversal.add_directory(std::move(directory),
+                                        number_of_path % threads);
+            }
+            else
+            {
+                collect_file(path, 
+                             traversal.add_root(path.parent_path().string()),
+                             number_of_path, options.filter, batch);
+            }
+        }
+        catch(const std::exception &e)
+        {
+            cerr << e.what() << '\n';
+        }
+    }
+    traversal.flush(batch);
+
+    vector<std::thread> workers;
+    for (size_t worker = 1; worker < threads; ++worker)
+    {
+        workers.emplace_back(&Traversal::run, &traversal, worker);
+    }
+    traversal.run(0);
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef TRAVERSE_H
+#define TRAVERSE_H
+
+#include "path_store.h"
+#include "scan_filter.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * A regular, non-empty file that was found during traversal.
+ */
+struct ScannedFile {
+    PathHandle path;
+    uintmax_t size;
+    std::filesystem::file_time_type m_time;
+    uintmax_t device; // Device and inode are 0 if not available
+    uintmax_t inode;
+    bool has_extra_links; // Hard link count is greater than one
+    std::size_t number_of_path;
+};
+
+/**
+ * Receives the files found by the traversal in batches. May be called from
+ * several threads, but never concurrently.
+ */
+using ScanSink = std::function<void(std::vector<ScannedFile> &batch)>;
+
+/**
+ * Options that control the traversal.
+ */
+struct TraversalOptions {
+    bool recurse;
+    // Number of worker threads. Zero means one thread per hardware thread.
+    std::size_t threads;
+    // Number of metadata requests submitted to io_uring at once. Zero means
+    // that the metadata is fetched synchronously.
+    unsigned queue_depth;
+    // Directories on other devices than the given path are skipped
+    bool one_file_system;
+    // The name rules apply to the entries found in the given paths, and the
+    // size bounds to all files
+    ScanFilter filter;
+    // If false, the names of the files are not stored, and the paths of the
+    // files handed to the sink are not valid. Directories are stored anyway.
+    bool store_names = true;
+};
+
+/**
+ * Traverses the given paths and passes the found files to the sink. The paths
+ * of the files are stored in the given store. The index of a path in the given
+ * vector is stored in the files found in it.
+ */
+void traverse_paths(const std::vector<std::filesystem::path> &paths,
+                    const TraversalOptions &options, PathStore &store,
+                    const ScanSink &sink);
+
+#endif // TRAVERSE_H
@@ -0,0 +1,191 @@
+#include "uring.h"
+
+#ifdef __linux__
+
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+/**
+ * Throws the error in errno as std::system_error.
+ */
+[[noreturn]] void throw_errno(const char *what)
+{
+    throw std::system_error(errno, std::system_category(), what);
+}
+
+/**
+ * Checks that the kernel supports all the given operations.
+ */
+bool supports(int ring_fd, std::initializer_list<int> operations)
+{
+    constexpr unsigned max_ops = 256;
+    std::vector<char> buffer(sizeof(io_uring_probe)
+                             + max_ops * sizeof(io_uring_probe_op));
+    auto *probe = reinterpret_cast<io_uring_probe *>(buffer.data());
+    if (::syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PROBE,
+                  probe, max_ops) < 0)
+    {
+        return false; // Kernels before 5.6 can't be probed
+    }
+    for (const int op : operations)
+    {
+        if (op > probe->last_op
+            || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename T>
+T *offset_pointer(void *base, unsigned offset)
+{
+    return reinterpret_cast<T *>(static_cast<char *>(base) + offset);
+}
+}
+
+IoUring::IoUring(unsigned queue_depth, std::initializer_list<int> operations)
+    : sq_ring(MAP_FAILED), sqes(static_cast<io_uring_sqe *>(MAP_FAILED)),
+      sqe_tail(0), cq_ring(MAP_FAILED)
+{
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    ring_fd = static_cast<int>(
+        ::syscall(__NR_io_uring_setup, queue_depth, &params));
+    if (ring_fd < 0)
+    {
+        throw_errno("io_uring_setup");
+    }
+
+    try
+    {
+        if (!supports(ring_fd, operations))
+        {
+            throw std::system_error(ENOTSUP, std::system_category(),
+                                    "io_uring operation");
+        }
+        entries = params.sq_entries;
+
+        sq_ring_size = params.sq_off.array + params.sq_entries
+                       * sizeof(unsigned);
+        sq_ring = ::mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring_fd,
+                         IORING_OFF_SQ_RING);
+        if (sq_ring == MAP_FAILED)
+        {
+            throw_errno("io_uring mmap");
+        }
+        sq_head = offset_pointer<unsigned>(sq_ring, params.sq_off.head);
+        sq_tail = offset_pointer<unsigned>(sq_ring, params.sq_off.tail);
+        sq_mask = offset_pointer<unsigned>(sq_ring, params.sq_off.ring_mask);
+        sq_array = offset_pointer<unsigned>(sq_ring, params.sq_off.array);
+        sqe_tail = *sq_tail;
+
+        sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe *>(
+            ::mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES));
+        if (sqes == MAP_FAILED)
+        {
+            throw_errno("io_uring mmap");
+        }
+
+        cq_ring_size = params.cq_off.cqes + params.cq_entries
+                       * sizeof(io_uring_cqe);
+        cq_ring = ::mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring_fd,
+                         IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED)
+        {
+            throw_errno("io_uring mmap");
+        }
+        cq_head = offset_pointer<unsigned>(cq_ring, params.cq_off.head);
+        cq_tail = offset_pointer<unsigned>(cq_ring, params.cq_off.tail);
+        cq_mask = offset_pointer<unsigned>(cq_ring, params.cq_off.ring_mask);
+        cqes = offset_pointer<io_uring_cqe>(cq_ring, params.cq_off.cqes);
+    }
+    catch(...)
+    {
+        release();
+        throw;
+    }
+}
+
+IoUring::~IoUring()
+{
+    release();
+}
+
+void IoUring::release()
+{
+    if (cq_ring != MAP_FAILED)
+    {
+        ::munmap(cq_ring, cq_ring_size);
+    }
+    if (sqes != MAP_FAILED)
+    {
+        ::munmap(sqes, sqes_size);
+    }
+    if (sq_ring != MAP_FAILED)
+    {
+        ::munmap(sq_ring, sq_ring_size);
+    }
+    ::close(ring_fd);
+}
+
+io_uring_sqe *IoUring::get_sqe()
+{
+    const unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    if (sqe_tail - head >= entries)
+    {
+        return nullptr;
+    }
+    const unsigned index = sqe_tail & *sq_mask;
+    io_uring_sqe *sqe = &sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sq_array[index] = index;
+    ++sqe_tail;
+    return sqe;
+}
+
+void IoUring::submit(unsigned wait_for)
+{
+    const unsigned to_submit = sqe_tail - *sq_tail;
+    // Make the added entries visible to the kernel
+    __atomic_store_n(sq_tail, sqe_tail, __ATOMIC_RELEASE);
+
+    if (to_submit == 0 && wait_for == 0)
+    {
+        return;
+    }
+    while (::syscall(__NR_io_uring_enter, ring_fd, to_submit, wait_for,
+                     wait_for > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0) < 0)
+    {
+        if (errno != EINTR)
+        {
+            throw_errno("io_uring_enter");
+        }
+    }
+}
+
+bool IoUring::next_cqe(io_uring_cqe &cqe)
+{
+    const unsigned head = *cq_head;
+    if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+    {
+        return false;
+    }
+    cqe = cqes[head & *cq_mask];
+    __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+#endif // __linux__
@@ -0,0 +1,74 @@
+#ifndef URING_H
+#define URING_H
+
+#ifdef __linux__
+
+#include <linux/io_uring.h>
+
+#include <cstddef>
+#include <initializer_list>
+
+/**
+ * A minimal io_uring instance, set up with raw system calls. Requests are
+ * added to the submission queue with get_sqe and submitted with submit.
+ * Completions are taken from the completion queue with next_cqe.
+ * Not thread safe, so each thread should have its own instance.
+ */
+class IoUring {
+        int ring_fd;
+        unsigned entries;
+
+        void *sq_ring;
+        std::size_t sq_ring_size;
+        unsigned *sq_head;
+        unsigned *sq_tail;
+        unsigned *sq_mask;
+        unsigned *sq_array;
+        io_uring_sqe *sqes;
+        std::size_t sqes_size;
+        unsigned sqe_tail; // Requests added but not yet made visible
+
+        void *cq_ring;
+        std::size_t cq_ring_size;
+        unsigned *cq_head;
+        unsigned *cq_tail;
+        unsigned *cq_mask;
+        io_uring_cqe *cqes;
+
+        void release();
+
+    public:
+        /**
+         * Sets up an instance with room for the given number of requests.
+         * Throws std::system_error if io_uring is not available, or if it
+         * doesn't support all the given operations.
+         */
+        IoUring(unsigned queue_depth, std::initializer_list<int> operations);
+        ~IoUring();
+        IoUring(const IoUring &) = delete;
+        IoUring &operator=(const IoUring &) = delete;
+
+        unsigned get_entries() const {return entries;}
+
+        /**
+         * Returns a cleared submission queue entry, or nullptr if the
+         * submission queue is full.
+         */
+        io_uring_sqe *get_sqe();
+
+        /**
+         * Submits the added requests and waits until at least the given number
+         * of them have completed.
+         */
+        void submit(unsigned wait_for);
+
+        /**
+         * Copies the next completion to the given entry and removes it from
+         * the completion queue. Returns false if there are no completions.
+         */
+        bool next_cqe(io_uring_cqe &cqe);
+};
+
+#endif // __linux__
+
+#endif // URING_H
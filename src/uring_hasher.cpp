@@ -0,0 +1,189 @@
+#include "uring_hasher.h"
+
+#ifdef __linux__
+
+#include "hash_kernel.h"
+
+#include <algorithm>
+#include <limits>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using std::size_t;
+using std::vector;
+
+namespace {
+// User data of close requests, whose completions need no handling
+constexpr uint64_t close_request = std::numeric_limits<uint64_t>::max();
+
+struct StateDeleter {
+    void operator()(void *state) const
+    {
+        hash_kernel().free_state(state);
+    }
+};
+}
+
+struct UringHasher::Slot {
+    FileId id;
+    // Kept until the file has been opened
+    std::string path;
+    int fd;
+    // Number of bytes hashed so far, and the number of bytes to hash
+    uintmax_t offset;
+    uintmax_t length;
+    std::unique_ptr<char[]> buffer;
+    std::unique_ptr<void, StateDeleter> state;
+};
+
+UringHasher::UringHasher(unsigned queue_depth, uintmax_t b, size_t buffer_size)
+    : kernel(hash_kernel()), bytes(b),
+      buffer_length(bytes == 0 ? std::max(buffer_size, size_t(1))
+          : static_cast<size_t>(std::min<uintmax_t>(
+              std::max(buffer_size, size_t(1)), bytes))),
+      ring(queue_depth, {IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_CLOSE}),
+      in_flight(0)
+{
+    slots.resize(ring.get_entries());
+    for (auto &slot : slots)
+    {
+        slot.fd = -1;
+        slot.buffer.reset(new char[buffer_length]);
+        slot.state.reset(kernel.create_state());
+    }
+}
+
+UringHasher::~UringHasher()
+{
+    for (const auto &slot : slots)
+    {
+        if (slot.fd >= 0)
+        {
+            ::close(slot.fd);
+        }
+    }
+}
+
+io_uring_sqe *UringHasher::next_sqe()
+{
+    io_uring_sqe *sqe = ring.get_sqe();
+    if (sqe == nullptr)
+    {
+        // Submitting empties the submission queue
+        ring.submit(0);
+        sqe = ring.get_sqe();
+    }
+    ++in_flight;
+    return sqe;
+}
+
+void UringHasher::open(size_t index, FileId id, const FileCatalog &files)
+{
+    Slot &slot = slots[index];
+    slot.id = id;
+    files.path(id, slot.path);
+    slot.offset = 0;
+    slot.length = bytes == 0 ? files.size(id)
+                             : std::min(bytes, files.size(id));
+    kernel.reset64(slot.state.get());
+
+    io_uring_sqe *sqe = next_sqe();
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = reinterpret_cast<uintptr_t>(slot.path.c_str());
+    sqe->open_flags = O_RDONLY | O_CLOEXEC;
+    sqe->user_data = index;
+}
+
+void UringHasher::read(size_t index)
+{
+    Slot &slot = slots[index];
+    io_uring_sqe *sqe = next_sqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = slot.fd;
+    sqe->addr = reinterpret_cast<uintptr_t>(slot.buffer.get());
+    sqe->len = static_cast<unsigned>(std::min<uintmax_t>(
+        buffer_length, slot.length - slot.offset));
+    sqe->off = slot.offset;
+    sqe->user_data = index;
+}
+
+void UringHasher::close(Slot &slot)
+{
+    io_uring_sqe *sqe = next_sqe();
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = slot.fd;
+    sqe->user_data = close_request;
+    slot.fd = -1;
+}
+
+void UringHasher::hash(const vector<FileId> &ids, const FileCatalog &files,
+                       PrefixHashes &hashes)
+{
+    size_t next = 0;
+    for (size_t index = 0; index < slots.size() && next < ids.size(); ++index)
+    {
+        open(index, ids[next++], files);
+    }
+
+    io_uring_cqe cqe;
+    while (in_flight > 0)
+    {
+        ring.submit(1);
+        while (ring.next_cqe(cqe))
+        {
+            --in_flight;
+            if (cqe.user_data == close_request)
+            {
+                continue;
+            }
+            const size_t index = static_cast<size_t>(cqe.user_data);
+            Slot &slot = slots[index];
+            bool finished = false;
+            if (slot.fd < 0)
+            {
+                // The file was opened
+                if (cqe.res < 0)
+                {
+                    finished = true;
+                }
+                else
+                {
+                    slot.fd = cqe.res;
+                    read(index);
+                }
+            }
+            else if (cqe.res < 0)
+            {
+                close(slot);
+                finished = true;
+            }
+            else
+            {
+                // A file that has been truncated ends with an empty read
+                kernel.update64(slot.state.get(), slot.buffer.get(),
+                                static_cast<size_t>(cqe.res));
+                slot.offset += static_cast<uintmax_t>(cqe.res);
+                if (cqe.res == 0 || slot.offset >= slot.length)
+                {
+                    hashes.set(slot.id, kernel.digest64(slot.state.get()));
+                    close(slot);
+                    finished = true;
+                }
+                else
+                {
+                    read(index);
+                }
+            }
+
+            if (finished && next < ids.size())
+            {
+                open(index, ids[next++], files);
+            }
+        }
+    }
+}
+
+#endif // __linux__
@@ -0,0 +1,66 @@
+#ifndef URING_HASHER_H
+#define URING_HASHER_H
+
+#ifdef __linux__
+
+#include "file_catalog.h"
+#include "hash_kernel.h"
+#include "prefix_hasher.h"
+#include "uring.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Hashes the beginnings of files with io_uring. Files are opened, read and
+ * closed asynchronously, as many at once as the queue depth allows, and each
+ * buffer is hashed as soon as its read completes. The hashes are the same as
+ * those of FileReader::hash.
+ *
+ * Files that can't be read are skipped, so that the error is reported when
+ * the file is hashed again during the deduplication. Not thread safe.
+ */
+class UringHasher {
+        struct Slot;
+
+        const HashKernel &kernel;
+        const uintmax_t bytes;
+        const std::size_t buffer_length;
+        // Files in flight. The ring is declared after them, so that it is
+        // closed before their buffers are freed.
+        std::vector<Slot> slots;
+        IoUring ring;
+        // Requests submitted but not yet completed
+        std::size_t in_flight;
+
+        io_uring_sqe *next_sqe();
+        void open(std::size_t index, FileId id, const FileCatalog &files);
+        void read(std::size_t index);
+        void close(Slot &slot);
+
+    public:
+        /**
+         * Parameter "b" is the number of bytes that are hashed from the
+         * beginning of each file, 0 meaning the whole file, and "buffer_size"
+         * the size of the buffer of each file in flight. Throws
+         * std::system_error if io_uring or the operations it needs are not
+         * available.
+         */
+        UringHasher(unsigned queue_depth, uintmax_t b, std::size_t buffer_size);
+        ~UringHasher();
+        UringHasher(const UringHasher &) = delete;
+        UringHasher &operator=(const UringHasher &) = delete;
+
+        /**
+         * Hashes the given files and stores the hashes.
+         */
+        void hash(const std::vector<FileId> &ids, const FileCatalog &files,
+                  PrefixHashes &hashes);
+};
+
+#endif // __linux__
+
+#endif // URING_HASHER_H
@@ -1,7 +1,12 @@
 #ifndef UTILITIES_H
 #define UTILITIES_H
 
+#include "file_catalog.h"
+
+#include <cstddef>
+#include <cstdint>
 #include <filesystem>
+#include <functional>
 #include <string>
 #include <unordered_map>
 #include <variant>
@@ -15,64 +20,72 @@ enum class Action
 
 // Possible types for command line arguments
 using Arg = std::variant<
-    bool, int, uintmax_t, Action, std::vector<std::filesystem::path>
+    bool, int, uintmax_t, Action, std::vector<std::filesystem::path>,
+    std::vector<std::string>
 >;
 
 // Container for retrieving command line arguments
 using ArgMap = std::unordered_map<std::string, Arg>;
 
-// Holds data from the beginning of a file
-using BeginningData = std::vector<char>;
-
 /**
- * Stores a file's path and last modification time. When the file is asked to be
- * deleted, the time is used to check if the file has been modified after it has
- * been scanned.
+ * A 128-bit hash digest. Ordered so that digests can be sorted.
  */
-struct File {
-    std::string path;
-    std::filesystem::file_time_type m_time;
-    std::size_t number_of_path;
-    File(std::string _path, std::filesystem::file_time_type _m_time, 
-         std::size_t number_of_path);
+struct Digest128 {
+    uint64_t low;
+    uint64_t high;
 };
 
-/**
- * A vector that contains identical Files.
- */
-using DuplicateVector = std::vector<File>;
+inline bool operator==(const Digest128 &a, const Digest128 &b)
+{
+    return a.low == b.low && a.high == b.high;
+}
 
-/**
- * Exception that is thrown when file stream is not valid.
- */
-class FileException : public std::system_error
+inline bool operator!=(const Digest128 &a, const Digest128 &b)
 {
-    public:
-        explicit FileException(std::error_code ec);
+    return !(a == b);
+}
+
+inline bool operator<(const Digest128 &a, const Digest128 &b)
+{
+    return a.high != b.high ? a.high < b.high : a.low < b.low;
+}
+
+namespace std {
+template <>
+struct hash<Digest128> {
+    // The bits of a digest are already evenly distributed
+    size_t operator()(const Digest128 &digest) const noexcept
+    {
+        return static_cast<size_t>(digest.low);
+    }
 };
+}
 
 /**
- * Returns true if the contents of the files in the given paths are exactly
- * the same.
+ * A vector that contains the ids of identical files.
  */
-bool compare_files(const std::string &path1,
-                  const std::string &path2);
+using DuplicateVector = std::vector<FileId>;
 
 /**
- * Return the 64-bit XXHash digest of the beginning of the file in the given 
- * path. Parameter "bytes" specifies the number of bytes that are considered.
- * If bytes == 0, the whole file is hashed.
+ * Sets of identical files, and the catalog that their metadata is in.
  */
-uint64_t hash_file(const std::string &path, uintmax_t bytes);
+struct Duplicates {
+    FileCatalog files;
+    std::vector<DuplicateVector> sets;
+};
 
 /**
- * Formats the given bytes as a string with a binary prefix.
+ * Exception that is thrown when a file can't be opened or read.
  */
-std::string format_bytes(uintmax_t bytes);
+class FileException : public std::system_error
+{
+    public:
+        explicit FileException(std::error_code ec);
+};
 
 /**
- * Returns the given number of bytes from the beginning of the given file.
+ * Formats the given bytes as a string with a binary prefix.
  */
-BeginningData read_file_beginning(const std::string &path, uintmax_t bytes);
+std::string format_bytes(uintmax_t bytes);
 
 #endif // UTILITIES_H
@@ -0,0 +1,89 @@
+#ifndef XXH3_KERNEL_H
+#define XXH3_KERNEL_H
+
+// Defines a hash kernel for the instruction set that the including file is
+// compiled for. xxHash is inlined, so that each kernel gets its own copy of
+// the functions. The including file shouldn't use inline functions from
+// other headers, because the linker could pick the copies that were compiled
+// for a newer instruction set for the whole program.
+
+#define XXH_INLINE_ALL
+
+#include "hash_kernel.h"
+#include "xxHash/xxhash.h"
+
+namespace {
+#if XXH_VECTOR == XXH_AVX2
+constexpr char xxh3_name[] = "avx2";
+#elif XXH_VECTOR == XXH_SSE2
+constexpr char xxh3_name[] = "sse2";
+#elif XXH_VECTOR == XXH_NEON
+constexpr char xxh3_name[] = "neon";
+#elif XXH_VECTOR == XXH_VSX
+constexpr char xxh3_name[] = "vsx";
+#else
+constexpr char xxh3_name[] = "scalar";
+#endif
+
+XXH3_state_t *state_of(void *state)
+{
+    return static_cast<XXH3_state_t*>(state);
+}
+
+const XXH3_state_t *state_of(const void *state)
+{
+    return static_cast<const XXH3_state_t*>(state);
+}
+
+// The state has members aligned to 64 bytes, which the vector code relies
+// on, so it is allocated with new instead of XXH3_createState
+void *xxh3_create_state()
+{
+    return new XXH3_state_t;
+}
+
+void xxh3_free_state(void *state)
+{
+    delete state_of(state);
+}
+
+void xxh3_reset64(void *state)
+{
+    XXH3_64bits_reset(state_of(state));
+}
+
+void xxh3_update64(void *state, const void *input, std::size_t length)
+{
+    XXH3_64bits_update(state_of(state), input, length);
+}
+
+uint64_t xxh3_digest64(const void *state)
+{
+    return XXH3_64bits_digest(state_of(state));
+}
+
+void xxh3_reset128(void *state)
+{
+    XXH3_128bits_reset(state_of(state));
+}
+
+void xxh3_update128(void *state, const void *input, std::size_t length)
+{
+    XXH3_128bits_update(state_of(state), input, length);
+}
+
+void xxh3_digest128(const void *state, uint64_t &low, uint64_t &high)
+{
+    const XXH128_hash_t digest = XXH3_128bits_digest(state_of(state));
+    low = digest.low64;
+    high = digest.high64;
+}
+
+constexpr HashKernel xxh3_kernel = {
+    xxh3_name, xxh3_create_state, xxh3_free_state,
+    xxh3_reset64, xxh3_update64, xxh3_digest64,
+    xxh3_reset128, xxh3_update128, xxh3_digest128
+};
+}
+
+#endif // XXH3_KERNEL_H
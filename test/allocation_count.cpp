@@ -0,0 +1,72 @@
+#include "allocation_count.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+std::atomic<std::size_t> count(0);
+
+void *allocate(std::size_t size)
+{
+    ++count;
+    // malloc may return nullptr for 0 bytes, but new may not
+    void *memory = std::malloc(size == 0 ? 1 : size);
+    if (memory == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void *allocate(std::size_t size, std::align_val_t alignment)
+{
+    ++count;
+    const std::size_t align = static_cast<std::size_t>(alignment);
+    // aligned_alloc needs a size that is a multiple of the alignment
+    void *memory = std::aligned_alloc(align, 
+        (size + align - 1) / align * align + (size == 0 ? align : 0));
+    if (memory == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+}
+
+std::size_t allocation_count()
+{
+    return count.load();
+}
+
+// The array and nothrow forms of the library call these
+
+void *operator new(std::size_t size)
+{
+    return allocate(size);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+    return allocate(size, alignment);
+}
+
+void operator delete(void *memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::align_val_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t, std::align_val_t) noexcept
+{
+    std::free(memory);
+}
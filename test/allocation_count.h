@@ -0,0 +1,13 @@
+#ifndef ALLOCATION_COUNT_H
+#define ALLOCATION_COUNT_H
+
+#include <cstddef>
+
+/**
+ * Returns the number of times that memory has been allocated with operator
+ * new in the test binary so far, by any thread. Memory that the containers
+ * get from an arena is counted only when the arena itself allocates.
+ */
+std::size_t allocation_count();
+
+#endif // ALLOCATION_COUNT_H
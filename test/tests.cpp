@@ -1,12 +1,26 @@
+#include "allocation_count.h"
 #include "deal_with_duplicates.h"
+#include "external_sort.h"
 #include "find_duplicates.h"
+#include "find_duplicates_base.h"
+#include "group_table.h"
+#include "hash_kernel.h"
 #include "catch2/catch.hpp"
 #include "parse.h"
+#include "prefix_arena.h"
+#include "radix_sort.h"
+#include "scan_filter.h"
+#include "size_sketch.h"
 #include "sys/stat.h"
 #include "utilities.h"
 
+#include <algorithm>
+#include <atomic>
 #include <filesystem>
 #include <fstream>
+#include <iomanip>
+#include <memory_resource>
+#include <random>
 #include <string>
 #include <variant>
 #include <vector>
@@ -37,6 +51,33 @@ fs::path create_test_dir()
     return test_dir_path;
 }
 
+/**
+ * Creates the given number of files of the given size in the given directory,
+ * named "<size>_<index>". Pairs of files are identical, and differ from the
+ * other pairs only in their last byte.
+ */
+void create_size_group(const fs::path &dir, int size, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        std::ofstream outfile (dir / 
+            (std::to_string(size) + "_" + std::to_string(i)));
+        outfile << string(size - 1, 'x') << i / 2;
+    }
+}
+
+/**
+ * Creates a group of the given number of files for each size from 1 to the
+ * given maximum size in the given directory, as create_size_group does.
+ */
+void create_size_groups(const fs::path &dir, int max_size, int count)
+{
+    for (int size = 1; size <= max_size; ++size)
+    {
+        create_size_group(dir, size, count);
+    }
+}
+
 ArgMap parse_cl_args(vector<string> arguments)
 {
     std::vector<char*> argv;
@@ -47,6 +88,28 @@ ArgMap parse_cl_args(vector<string> arguments)
     return parse(argv.size() - 1, argv.data());
 }
 
+/**
+ * Returns the file names of the sets of duplicates, sorted so that they can
+ * be compared regardless of the order in which they were found.
+ */
+vector<vector<string>> sorted_names(const Duplicates &duplicates)
+{
+    vector<vector<string>> sets;
+    for (const auto &set : duplicates.sets)
+    {
+        vector<string> names;
+        for (const auto id : set)
+        {
+            names.push_back(
+                fs::path(duplicates.files.path(id)).filename().string());
+        }
+        std::sort(names.begin(), names.end());
+        sets.push_back(names);
+    }
+    std::sort(sets.begin(), sets.end());
+    return sets;
+}
+
 ino_t get_inode(fs::path path)
 {
     struct stat s;
@@ -54,6 +117,13 @@ ino_t get_inode(fs::path path)
     return s.st_ino;
 }
 
+dev_t get_device(fs::path path)
+{
+    struct stat s;
+    stat(path.string().c_str(), &s);
+    return s.st_dev;
+}
+
 TEST_CASE( "test_delete" )
 {
     const fs::path test_dir_path = create_test_dir(); 
@@ -324,3 +394,1015 @@ TEST_CASE( "test_not_recursive" )
     REQUIRE (count_files(test_dir_path) == 1); 
     REQUIRE (count_files(test_dir_path / "a_dir") == 1); 
 }
+
+TEST_CASE( "test_parallel_scan" )
+{
+    const fs::path test_dir_path = create_test_dir();
+
+    // Two trees with identical content, the second one given first
+    for (const auto &root : {"dir1", "dir2"})
+    {
+        for (int i = 0; i < 8; ++i)
+        {
+            fs::path dir = test_dir_path / root / std::to_string(i);
+            fs::create_directories(dir / "sub");
+            std::ofstream outfile (dir / "sub" / "test.txt");
+            outfile << "Test text " << i << "!" << std::endl;
+            outfile.close();
+        }
+    }
+
+    std::vector<std::string> arguments =
+        {"dedup", "-rdd", "-j", "4", (test_dir_path / "dir2").string(),
+                                     (test_dir_path / "dir1").string()
+        };
+
+    ArgMap cl_args = parse_cl_args(arguments);
+
+    const auto duplicates = find_duplicates<uint64_t>(cl_args);
+
+    REQUIRE (duplicates.sets.size() == 8);
+
+    deal_with_duplicates(Action::no_prompt_delete, duplicates);
+
+    for (int i = 0; i < 8; ++i)
+    {
+        const fs::path sub = fs::path(std::to_string(i)) / "sub";
+        REQUIRE (count_files(test_dir_path / "dir1" / sub) == 0);
+        REQUIRE (count_files(test_dir_path / "dir2" / sub) == 1);
+    }
+}
+
+TEST_CASE( "test_many_hard_links" )
+{
+    const fs::path test_dir_path = create_test_dir();
+
+    // 1000 different files of the same size, each with 100 hard links
+    constexpr int file_count = 1000;
+    constexpr int link_count = 100;
+    for (int i = 0; i < link_count; ++i)
+    {
+        fs::create_directory(test_dir_path / std::to_string(i));
+    }
+    for (int i = 0; i < file_count; ++i)
+    {
+        const fs::path path = test_dir_path / "0" / std::to_string(i);
+        std::ofstream outfile (path);
+        outfile << std::setw(8) << i << std::endl;
+        outfile.close();
+        for (int j = 1; j < link_count; ++j)
+        {
+            fs::create_hard_link(path, 
+                test_dir_path / std::to_string(j) / std::to_string(i));
+        }
+    }
+
+    std::vector<std::string> arguments =
+        {"dedup", "-r", test_dir_path.string()};
+
+    ArgMap cl_args = parse_cl_args(arguments);
+
+    FileCatalog files;
+    FileSizeTable file_size_table;
+    REQUIRE (scan_all_paths(files, file_size_table, cl_args) == file_count);
+    REQUIRE (file_size_table.size() == 1);
+
+    const auto duplicates = find_duplicates<uint64_t>(cl_args);
+
+    REQUIRE (duplicates.sets.empty());
+}
+
+TEST_CASE( "test_scan_queue_depth" )
+{
+    const fs::path test_dir_path = create_test_dir();
+
+    for (int i = 0; i < 50; ++i)
+    {
+        const fs::path dir = test_dir_path / std::to_string(i % 5);
+        fs::create_directories(dir);
+        std::ofstream outfile (dir / std::to_string(i));
+        outfile << std::string(i % 7, 'x');
+        outfile.close();
+    }
+    fs::create_symlink(test_dir_path / "0" / "1", test_dir_path / "link");
+
+    std::vector<std::string> arguments =
+        {"dedup", "-r", test_dir_path.string()};
+    FileCatalog sync_files;
+    FileSizeTable sync_table;
+    const size_t sync_count = 
+        scan_all_paths(sync_files, sync_table, parse_cl_args(arguments));
+
+    arguments.push_back("--scan-queue-depth");
+    arguments.push_back("4");
+    FileCatalog batched_files;
+    FileSizeTable batched_table;
+    const size_t batched_count = 
+        scan_all_paths(batched_files, batched_table, parse_cl_args(arguments));
+
+    // Empty files and the symlink are skipped
+    REQUIRE (sync_count == 42);
+    REQUIRE (batched_count == sync_count);
+    REQUIRE (batched_table.size() == sync_table.size());
+}
+
+TEST_CASE( "test_hard_link_in_first_path" )
+{
+    const fs::path test_dir_path = create_test_dir();
+    const fs::path first = test_dir_path / "first";
+    const fs::path second = test_dir_path / "second";
+    fs::create_directory(first);
+    fs::create_directory(second);
+
+    std::ofstream outfile (second / "original.txt");
+    outfile << "Test text!" << std::endl;
+    outfile.close();
+    fs::copy_file(second / "original.txt", second / "copy.txt");
+    fs::create_hard_link(second / "original.txt", first / "link.txt");
+
+    std::vector<std::string> arguments =
+        {"dedup", first.string(), second.string()};
+
+    FileCatalog files;
+    FileSizeTable file_size_table;
+    REQUIRE (scan_all_paths(files, file_size_table, 
+                            parse_cl_args(arguments)) == 2);
+    REQUIRE (files.count() == 2);
+
+    // Whichever link is found first, the one in the first path is kept
+    const ino_t inode = get_inode(first / "link.txt");
+    for (FileId id = 0; id < files.count(); ++id)
+    {
+        if (files.inode(id) == inode)
+        {
+            REQUIRE (files.number_of_path(id) == 0);
+            REQUIRE (fs::path(files.path(id)) == first / "link.txt");
+        }
+    }
+}
+
+TEST_CASE( "test_pipeline" )
+{
+    const fs::path test_dir_path = create_test_dir();
+
+    // 10 different contents of the same size, which differ only after the
+    // hashed beginning, three copies of each, and one file of unique size
+    for (int i = 0; i < 30; ++i)
+    {
+        fs::path dir = test_dir_path / std::to_string(i % 4);
+        fs::create_directories(dir);
+        std::ofstream outfile (dir / std::to_string(i));
+        outfile << std::string(64, 'x') << std::setw(8) << i % 10 << std::endl;
+        outfile.close();
+    }
+    std::ofstream outfile (test_dir_path / "unique");
+    outfile << "Unique" << std::endl;
+    outfile.close();
+
+    for (const auto &engine : {"", "-t", "-v"})
+    {
+        std::vector<std::string> arguments =
+            {"dedup", "-r", "-b", "16", test_dir_path.string()};
+        if (std::string(engine) != "")
+        {
+            arguments.push_back(engine);
+        }
+        const auto duplicates = find_duplicates<uint64_t>(
+            parse_cl_args(arguments));
+
+        arguments.push_back("-p");
+        const auto pipelined = find_duplicates<uint64_t>(
+            parse_cl_args(arguments));
+
+        REQUIRE (duplicates.sets.size() == 10);
+        REQUIRE (pipelined.sets.size() == duplicates.sets.size());
+        for (const auto &set : pipelined.sets)
+        {
+            REQUIRE (set.size() == 3);
+        }
+    }
+
+    // Files that are hashed whole with 128-bit digests don't need the hash
+    // of their beginning
+    for (const auto &bytes : {"16", "4096"})
+    {
+        FileCatalog files;
+        FileSizeTable file_size_table;
+        PrefixHashes prefix_hashes;
+        scan_all_paths(files, file_size_table, parse_cl_args({"dedup", "-r",
+            "-p", "-a", "16", "-b", bytes, test_dir_path.string()}),
+            &prefix_hashes);
+        const bool hashed = std::string(bytes) == "16";
+        for (const auto &same_size : file_size_table)
+        {
+            for (const auto id : same_size.second)
+            {
+                REQUIRE (prefix_hashes.contains(id)
+                         == (hashed && same_size.second.size() > 1));
+            }
+        }
+    }
+}
+
+TEST_CASE( "test_scan_filter" )
+{
+    const fs::path test_dir_path = create_test_dir();
+
+    // Identical files in the given directory, in an excluded directory and
+    // in a subdirectory of it, with various names and sizes
+    for (const auto &dir : {"", ".git", ".git/objects", "src"})
+    {
+        fs::create_directories(test_dir_path / dir);
+        for (const auto &name : {"a.txt", "b.txt", "c.tmp", "d.dat"})
+        {
+            std::ofstream outfile (test_dir_path / dir / name);
+            outfile << std::string(std::string(name) == "d.dat" ? 1000 : 10,
+                                   'x');
+            outfile.close();
+        }
+    }
+
+    std::vector<std::string> arguments =
+        {"dedup", "-r", "--exclude", ".git,*.tmp", "--include", "*.txt",
+         "--include", "?.dat", "--min-size", "5", "--max-size", "100",
+         test_dir_path.string()};
+
+    FileCatalog files;
+    FileSizeTable file_size_table;
+    REQUIRE (scan_all_paths(files, file_size_table, 
+                            parse_cl_args(arguments)) == 4);
+    for (FileId id = 0; id < files.count(); ++id)
+    {
+        const fs::path path = files.path(id);
+        REQUIRE (path.extension() == ".txt");
+        REQUIRE (path.string().find(".git") == std::string::npos);
+    }
+
+    REQUIRE (Glob("*.t[!a-m]t").matches("notes.txt"));
+    REQUIRE_FALSE (Glob("*.t[!a-z]t").matches("notes.txt"));
+    REQUIRE (Glob("a*b*c").matches("aXbYbZc"));
+    REQUIRE_FALSE (Glob("a*b*c").matches("aXbYbZ"));
+    REQUIRE (Glob("\\*[]]").matches("*]"));
+
+    // Bounds that no file can meet are an error, but equal bounds are not
+    REQUIRE_THROWS_AS (parse_cl_args({"dedup", "--min-size", "101",
+        "--max-size", "100", test_dir_path.string()}), EndException);
+    REQUIRE_NOTHROW (parse_cl_args({"dedup", "--min-size", "100",
+        "--max-size", "100", test_dir_path.string()}));
+    REQUIRE_NOTHROW (parse_cl_args({"dedup", "--min-size", "101",
+        test_dir_path.string()}));
+}
+
+TEST_CASE( "test_one_file_system" )
+{
+    const fs::path test_dir_path = create_test_dir();
+    std::ofstream outfile (test_dir_path / "test.txt");
+    outfile << "Test text!" << std::endl;
+    outfile.close();
+
+    // Files on pseudo file systems are skipped
+    if (fs::is_directory("/sys/kernel"))
+    {
+        std::vector<std::string> arguments = {"dedup", "/sys/kernel"};
+        FileCatalog files;
+        FileSizeTable file_size_table;
+        REQUIRE (scan_all_paths(files, file_size_table, 
+                                parse_cl_args(arguments)) == 0);
+    }
+
+    // A temporary directory that is on another file system than its parent,
+    // such as /dev/shm
+    const fs::path mount = fs::temp_directory_path();
+    const fs::path parent = mount.parent_path();
+    if (get_device(mount) != get_device(parent)
+        && get_device(test_dir_path) == get_device(mount))
+    {
+        for (const auto &one_file_system : {false, true})
+        {
+            std::vector<std::string> arguments = 
+                {"dedup", "-r", "--include", "test.txt", parent.string()};
+            if (one_file_system)
+            {
+                arguments.push_back("-x");
+            }
+            FileCatalog files;
+            FileSizeTable file_size_table;
+            scan_all_paths(files, file_size_table, parse_cl_args(arguments));
+
+            bool found = false;
+            for (FileId id = 0; id < files.count(); ++id)
+            {
+                found |= fs::path(files.path(id)) == test_dir_path / "test.txt";
+            }
+            REQUIRE (found == !one_file_system);
+        }
+    }
+}
+
+TEST_CASE( "test_buffer_size" )
+{
+    const fs::path test_dir_path = create_test_dir();
+
+    // Pairs of files that differ only in their last byte, which is read into
+    // the buffer after several full ones. The size of the second group is a
+    // multiple of the buffer size.
+    create_size_group(test_dir_path, 100, 6);
+    create_size_group(test_dir_path, 98, 6);
+
+    for (const auto &engine : {"", "-t", "-v", "-n"})
+    {
+        for (const auto &bytes : {"0", "20"})
+        {
+            std::vector<std::string> arguments =
+                {"dedup", "--buffer-size", "7", "-b", bytes, 
+                 test_dir_path.string()};
+            if (std::string(engine) != "")
+            {
+                arguments.push_back(engine);
+            }
+            const auto duplicates = find_duplicates<uint64_t>(
+                parse_cl_args(arguments));
+
+            REQUIRE (duplicates.sets.size() == 6);
+            for (const auto &set : duplicates.sets)
+            {
+                REQUIRE (set.size() == 2);
+            }
+        }
+    }
+}
+
+TEST_CASE( "test_mmap" )
+{
+    const fs::path test_dir_path = create_test_dir();
+
+    // Files that span several memory map windows. Two copies of the same
+    // content, and files that differ from it early, late, and in the last
+    // byte.
+    const size_t size = 5 << 20;
+    std::string content(size, 'x');
+    for (size_t i = 0; i < size; i += 4096)
+    {
+        content[i] = static_cast<char>(i / 4096);
+    }
+    const std::vector<std::pair<std::string, size_t>> variants = 
+        {{"copy", 0}, {"early", 5000}, {"late", 3 << 20}, {"last", size - 1}};
+    for (const auto &variant : variants)
+    {
+        std::string data = content;
+        if (variant.second != 0)
+        {
+            data[variant.second] = 'y';
+        }
+        std::ofstream outfile (test_dir_path / variant.first, std::ios::binary);
+        outfile << data;
+        outfile.close();
+    }
+    std::ofstream outfile (test_dir_path / "original", std::ios::binary);
+    outfile << content;
+    outfile.close();
+
+    for (const auto &engine : {"", "-v"})
+    {
+        std::vector<std::string> arguments =
+            {"dedup", "--mmap", "1", test_dir_path.string()};
+        if (std::string(engine) != "")
+        {
+            arguments.push_back(engine);
+        }
+        const auto duplicates = find_duplicates<uint64_t>(
+            parse_cl_args(arguments));
+
+        REQUIRE (duplicates.sets.size() == 1);
+        REQUIRE (duplicates.sets[0].size() == 2);
+        for (const auto id : duplicates.sets[0])
+        {
+            const auto name = fs::path(duplicates.files.path(id)).filename();
+            REQUIRE ((name == "copy" || name == "original"));
+        }
+    }
+}
+
+TEST_CASE( "test_group_verifier" )
+{
+    const fs::path test_dir_path = create_test_dir();
+
+    // Files of the same size with the same hashed beginning, which differ in
+    // the following chunks, four copies of each content
+    for (int i = 0; i < 16; ++i)
+    {
+        std::ofstream outfile (test_dir_path / std::to_string(i));
+        outfile << std::string(16, 'x') << std::string(i % 4 * 3, 'y') 
+                << std::string(9 - i % 4 * 3, 'z');
+        outfile.close();
+    }
+
+    for (const auto &engine : {"", "-t", "-v", "-n"})
+    {
+        for (const auto &open_files : {"0", "256"})
+        {
+            std::vector<std::string> arguments =
+                {"dedup", "-b", "16", "--buffer-size", "4", "--open-files", 
+                 open_files, test_dir_path.string()};
+            if (std::string(engine) != "")
+            {
+                arguments.push_back(engine);
+            }
+            const auto duplicates = find_duplicates<uint64_t>(
+                parse_cl_args(arguments));
+
+            REQUIRE (duplicates.sets.size() == 4);
+            for (const auto &set : duplicates.sets)
+            {
+                REQUIRE (set.size() == 4);
+            }
+        }
+    }
+}
+
+TEST_CASE( "test_hash_threads" )
+{
+    const fs::path test_dir_path = create_test_dir();
+
+    create_size_groups(test_dir_path, 12, 5);
+
+    for (const auto &engine : {"", "-t", "-v", "-n"})
+    {
+        // The sets of file names, which are the same with any thread count
+        vector<vector<string>> expected;
+        for (const auto &threads : {"1", "4", "0"})
+        {
+            std::vector<std::string> arguments =
+                {"dedup", "--hash-threads", threads, test_dir_path.string()};
+            if (std::string(engine) != "")
+            {
+                arguments.push_back(engine);
+            }
+            const auto duplicates = find_duplicates<uint64_t>(
+                parse_cl_args(arguments));
+
+            const auto sets = sorted_names(duplicates);
+            REQUIRE (sets.size() == 24);
+            if (expected.empty())
+            {
+                expected = sets;
+            }
+            REQUIRE (sets == expected);
+        }
+    }
+
+    // The threads share the limits of open files and memory
+    const ArgMap cl_args = parse_cl_args({"dedup", "--hash-threads", "64",
+                                          test_dir_path.string()});
+    REQUIRE (thread_share(256, cl_args) == 4);
+    REQUIRE (thread_share(16, cl_args) == 1);
+    REQUIRE (thread_share(0, cl_args) == 0);
+
+    // Spare threads are lent only as far as there are any, and given back
+    std::atomic<unsigned> spare(3);
+    {
+        const SpareThreads first(spare, 2);
+        const SpareThreads second(spare, 2);
+        REQUIRE (first.size() == 2);
+        REQUIRE (second.size() == 1);
+        REQUIRE (spare == 0);
+    }
+    REQUIRE (spare == 3);
+}
+
+TEST_CASE( "test_hash_queue_depth" )
+{
+    const fs::path test_dir_path = create_test_dir();
+
+    // There are more files than requests in flight, and the files are longer
+    // than the buffers. The files are not compared in memory, which would
+    // leave them unhashed.
+    create_size_groups(test_dir_path, 12, 5);
+
+    for (const auto &engine : {"", "-t", "-v", "-p"})
+    {
+        for (const auto &bytes : {"0", "8"})
+        {
+            vector<vector<string>> expected;
+            for (const auto &depth : {"0", "2", "256"})
+            {
+                std::vector<std::string> arguments =
+                    {"dedup", "--hash-queue-depth", depth, "-b", bytes,
+                     "--buffer-size", "3", "--compare-memory", "0",
+                     test_dir_path.string()};
+                if (std::string(engine) != "")
+                {
+                    arguments.push_back(engine);
+                }
+                const auto sets = sorted_names(find_duplicates<uint64_t>(
+                    parse_cl_args(arguments)));
+
+                REQUIRE (sets.size() == 24);
+                if (expected.empty())
+                {
+                    expected = sets;
+                }
+                REQUIRE (sets == expected);
+            }
+        }
+    }
+}
+
+TEST_CASE( "test_stages" )
+{
+    const fs::path test_dir_path = create_test_dir();
+
+    // Files of the same size with the same beginning, which differ in the 
+    // middle, in the end, or in a part that no sample covers, and pairs of
+    // duplicates
+    const size_t size = 100000;
+    const std::string content(size, 'x');
+    const std::vector<std::pair<std::string, size_t>> variants = 
+        {{"middle", size / 2}, {"end", size - 1}, {"unsampled", 5000},
+         {"copy", 0}, {"original", 0}};
+    for (const auto &variant : variants)
+    {
+        std::string data = content;
+        if (variant.second != 0)
+        {
+            data[variant.second] = 'y';
+        }
+        std::ofstream outfile (test_dir_path / variant.first, std::ios::binary);
+        outfile << data;
+        outfile.close();
+    }
+
+    for (const auto &stages : {"prefix,tail,samples", "prefix,full", 
+                               "samples,head,tail,prefix", "full,prefix"})
+    {
+        for (const auto &bytes : {"0", "16"})
+        {
+            const auto duplicates = find_duplicates<uint64_t>(parse_cl_args(
+                {"dedup", "-t", "--stages", stages, "-b", bytes,
+                 test_dir_path.string()}));
+
+            REQUIRE (duplicates.sets.size() == 1);
+            REQUIRE (duplicates.sets[0].size() == 2);
+            for (const auto id : duplicates.sets[0])
+            {
+                const auto name = fs::path(duplicates.files.path(id)).filename();
+                REQUIRE ((name == "copy" || name == "original"));
+            }
+        }
+    }
+}
+
+TEST_CASE( "test_compare_in_memory" )
+{
+    const fs::path test_dir_path = create_test_dir();
+
+    create_size_groups(test_dir_path, 12, 5);
+
+    // The groups are compared in memory if the hashed beginnings cover the
+    // files and the groups fit in memory, partly or not at all
+    for (const auto &engine : {"", "-t", "-v", "-n"})
+    {
+        vector<vector<string>> expected;
+        for (const auto &memory : {"0", "40", "67108864"})
+        {
+            for (const auto &bytes : {"0", "6", "4096"})
+            {
+                std::vector<std::string> arguments =
+                    {"dedup", "--compare-memory", memory, "-b", bytes, 
+                     test_dir_path.string()};
+                if (std::string(engine) != "")
+                {
+                    arguments.push_back(engine);
+                }
+                const auto sets = sorted_names(find_duplicates<uint64_t>(
+                    parse_cl_args(arguments)));
+
+                REQUIRE (sets.size() == 24);
+                if (expected.empty())
+                {
+                    expected = sets;
+                }
+                REQUIRE (sets == expected);
+            }
+        }
+    }
+}
+
+TEST_CASE( "test_trust_hash" )
+{
+    const fs::path test_dir_path = create_test_dir();
+
+    create_size_groups(test_dir_path, 12, 5);
+
+    // 128-bit digests find the same duplicates as the other digests, whether
+    // they are trusted or the files are compared. The files are not compared
+    // in memory.
+    const auto expected = sorted_names(find_duplicates<uint64_t>(
+        parse_cl_args({"dedup", test_dir_path.string()})));
+    REQUIRE (expected.size() == 24);
+    for (const auto &engine : {"", "-t", "-v"})
+    {
+        for (const auto &options : vector<vector<string>>{
+                 {"-a", "16"}, {"-a", "16", "--trust-hash"},
+                 {"-a", "16", "--trust-hash", "--stages", "prefix,full"}})
+        {
+            for (const auto &bytes : {"0", "6"})
+            {
+                std::vector<std::string> arguments =
+                    {"dedup", "-b", bytes, "--compare-memory", "0",
+                     test_dir_path.string()};
+                arguments.insert(arguments.end(), options.begin(), 
+                                 options.end());
+                if (std::string(engine) != "")
+                {
+                    arguments.push_back(engine);
+                }
+                const auto sets = sorted_names(find_duplicates<Digest128>(
+                    parse_cl_args(arguments)));
+
+                REQUIRE (sets == expected);
+            }
+        }
+    }
+}
+
+TEST_CASE( "test_hash_kernels" )
+{
+    vector<char> data(1 << 20);
+    uint64_t x = 88172645463325252ull;
+    for (auto &byte : data)
+    {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        byte = static_cast<char>(x);
+    }
+
+    const auto kernels = supported_hash_kernels();
+    REQUIRE (&hash_kernel() == kernels.front());
+
+    // Every kernel must produce the same digests, whether the data is hashed
+    // at once or in pieces
+    for (const size_t length : {0, 1, 17, 129, 240, 241, 1024, 100000,
+                                1 << 20})
+    {
+        vector<uint64_t> digests;
+        for (const auto *kernel : kernels)
+        {
+            void *state = kernel->create_state();
+            for (const size_t piece : {length, size_t(777)})
+            {
+                kernel->reset64(state);
+                for (size_t i = 0; i < length; i += std::max(piece, 
+                                                             size_t(1)))
+                {
+                    kernel->update64(state, data.data() + i, 
+                                     std::min(piece, length - i));
+                }
+                digests.push_back(kernel->digest64(state));
+
+                kernel->reset128(state);
+                for (size_t i = 0; i < length; i += std::max(piece, 
+                                                             size_t(1)))
+                {
+                    kernel->update128(state, data.data() + i, 
+                                      std::min(piece, length - i));
+                }
+                uint64_t low = 0;
+                uint64_t high = 0;
+                kernel->digest128(state, low, high);
+                digests.push_back(low);
+                digests.push_back(high);
+            }
+            kernel->free_state(state);
+        }
+        for (size_t i = 3; i < digests.size(); ++i)
+        {
+            REQUIRE (digests[i] == digests[i % 3]);
+        }
+    }
+}
+
+TEST_CASE( "test_group_table" )
+{
+    // The table starts small and grows, and keys of the same home slot
+    // displace each other
+    GroupTable<uint64_t> table;
+    constexpr FileId file_count = 100000;
+    for (FileId id = 0; id < file_count; ++id)
+    {
+        // Every third key is alone, the others are shared by two ids
+        const uint64_t key = id % 3 == 0 ? uint64_t(id) << 32 | 1 
+                                         : uint64_t(id / 3) << 8;
+        table.insert(key, id);
+    }
+    REQUIRE (table.size() == file_count / 3 * 2 + 1);
+
+    vector<vector<FileId>> groups;
+    const size_t single_count = table.for_each_group(
+        [&groups](const FileId *ids, size_t count)
+        {
+            groups.emplace_back(ids, ids + count);
+        });
+    REQUIRE (single_count == file_count / 3 + 1);
+    REQUIRE (groups.size() == file_count / 3);
+
+    // Groups come in the order of their first ids, and ids in insertion
+    // order
+    for (size_t i = 0; i < groups.size(); ++i)
+    {
+        REQUIRE (groups[i] == vector<FileId>{FileId(3 * i + 1), 
+                                             FileId(3 * i + 2)});
+    }
+
+    GroupTable<Digest128> digests(2);
+    digests.insert(Digest128{1, 2}, 0);
+    digests.insert(Digest128{2, 1}, 1);
+    digests.insert(Digest128{1, 2}, 2);
+    groups.clear();
+    REQUIRE (digests.for_each_group([&groups](const FileId *ids,
+                                              size_t count)
+        {
+            groups.emplace_back(ids, ids + count);
+        }) == 1);
+    REQUIRE (groups == vector<vector<FileId>>{{0, 2}});
+}
+
+TEST_CASE( "test_radix_sort" )
+{
+    // Radix sort must give the same order as a stable comparison sort, for
+    // inputs that are sorted by comparison, in one chunk, and in several
+    const auto check = [](auto entries, unsigned threads)
+    {
+        auto expected = entries;
+        std::stable_sort(expected.begin(), expected.end(),
+                         [](const auto &a, const auto &b)
+                         {
+                             return a.first < b.first;
+                         });
+        radix_sort(entries, threads);
+        REQUIRE (entries == expected);
+    };
+
+    uint64_t state = 1;
+    const auto next = [&state]()
+    {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        return state;
+    };
+    for (const size_t count : {size_t(100), size_t(5000), size_t(600000)})
+    {
+        vector<std::pair<uint8_t, FileId>> bytes;
+        vector<std::pair<uint64_t, FileId>> words;
+        vector<std::pair<Digest128, FileId>> digests;
+        for (FileId id = 0; id < count; ++id)
+        {
+            const uint64_t random = next();
+            bytes.emplace_back(uint8_t(random >> 56), id);
+            // Shared high bytes are skipped, and there are equal keys
+            words.emplace_back(random >> 48 | 0xab00000000000000ull, id);
+            digests.emplace_back(Digest128{random >> 60, next() >> 62}, id);
+        }
+        check(bytes, 1);
+        check(words, 1);
+        check(words, 3);
+        check(digests, 3);
+    }
+}
+
+TEST_CASE( "test_prefix_arena" )
+{
+    // Slots that share their first 8 bytes or differ only after them, and
+    // slots shorter than 8 bytes, are ordered by their whole contents
+    for (const size_t width : {size_t(3), size_t(8), size_t(20)})
+    {
+        for (const uintmax_t memory_limit : {uintmax_t(0), uintmax_t(1)})
+        {
+            constexpr size_t slot_count = 1000;
+            PrefixArena arena(width, slot_count, memory_limit);
+#ifdef __linux__
+            REQUIRE (arena.spilled() == (memory_limit != 0));
+#endif
+            for (size_t index = 0; index < slot_count; ++index)
+            {
+                for (size_t i = 0; i < width; ++i)
+                {
+                    arena.slot(index)[i] = static_cast<char>(
+                        i + 1 == width ? index * 37 % 11 : index % 3 + 200);
+                }
+            }
+
+            std::pmr::vector<FileId> expected(slot_count);
+            for (size_t index = 0; index < slot_count; ++index)
+            {
+                expected[index] = static_cast<FileId>(index);
+            }
+            std::stable_sort(expected.begin(), expected.end(),
+                [&arena, width](FileId a, FileId b)
+                {
+                    return std::lexicographical_compare(
+                        reinterpret_cast<unsigned char*>(arena.slot(a)),
+                        reinterpret_cast<unsigned char*>(arena.slot(a)
+                                                         + width),
+                        reinterpret_cast<unsigned char*>(arena.slot(b)),
+                        reinterpret_cast<unsigned char*>(arena.slot(b)
+                                                         + width));
+                });
+            REQUIRE (arena.order(slot_count) == expected);
+        }
+    }
+
+    // Beginnings kept in temporary files find the same duplicates
+    const fs::path test_dir_path = create_test_dir();
+    create_size_groups(test_dir_path, 12, 5);
+    const auto expected = sorted_names(find_duplicates<uint64_t>(
+        parse_cl_args({"dedup", test_dir_path.string()})));
+    REQUIRE (expected.size() == 24);
+    for (const auto &memory_limit : {"0", "1"})
+    {
+        for (const auto &bytes : {"0", "4", "4096"})
+        {
+            const auto sets = sorted_names(find_duplicates<uint64_t>(
+                parse_cl_args({"dedup", "-n", "-b", bytes, 
+                               "--compare-memory", "0", "--memory-limit", 
+                               memory_limit, test_dir_path.string()})));
+            REQUIRE (sets == expected);
+        }
+    }
+}
+
+TEST_CASE( "test_low_memory" )
+{
+    // The sketch grows while sizes are added, and keeps only the repeated
+    // sizes
+    SizeSketch sketch;
+    constexpr uintmax_t size_count = 100000;
+    for (uintmax_t size = 1; size <= size_count; ++size)
+    {
+        sketch.add(size << 20);
+        if (size % 4 == 0)
+        {
+            sketch.add(size << 20);
+        }
+    }
+    REQUIRE (sketch.size_count() == size_count);
+    REQUIRE (sketch.drop_unique() == size_count / 4 * 3);
+    REQUIRE (sketch.size_count() == size_count / 4);
+    for (uintmax_t size = 1; size <= size_count; ++size)
+    {
+        REQUIRE (sketch.repeated(size << 20) == (size % 4 == 0));
+    }
+    REQUIRE (!sketch.repeated(3));
+
+    // Files of unique size, duplicates, and files that only share a size.
+    // The two passes find the same duplicates as one pass.
+    const fs::path test_dir_path = create_test_dir();
+    for (int size = 1; size <= 12; ++size)
+    {
+        create_size_group(test_dir_path, size, size % 3 == 0 ? 1 : 5);
+    }
+    const auto expected = sorted_names(find_duplicates<uint64_t>(
+        parse_cl_args({"dedup", test_dir_path.string()})));
+    REQUIRE (expected.size() == 16);
+    for (const auto &engine : {"", "-n", "-t", "-v"})
+    {
+        std::vector<std::string> arguments =
+            {"dedup", "--low-memory", test_dir_path.string()};
+        if (std::string(engine) != "")
+        {
+            arguments.push_back(engine);
+        }
+        REQUIRE (sorted_names(find_duplicates<uint64_t>(
+            parse_cl_args(arguments))) == expected);
+    }
+
+    // A size shared only by the hard links of one file is unique, so the
+    // file is skipped in the first pass
+    const fs::path links_path = test_dir_path / "links";
+    fs::create_directories(links_path);
+    for (const auto &name : {"linked", "same_1", "same_2"})
+    {
+        std::ofstream outfile (links_path / name);
+        outfile << (name[0] == 'l' ? "longer" : "short");
+    }
+    fs::create_hard_link(links_path / "linked", links_path / "link");
+    FileCatalog files;
+    std::pmr::monotonic_buffer_resource scan_arena;
+    FileSizeTable file_size_table(&scan_arena);
+    REQUIRE (scan_all_paths(files, file_size_table, parse_cl_args(
+        {"dedup", "--low-memory", links_path.string()})) == 2);
+}
+
+TEST_CASE( "test_external_memory" )
+{
+    // Runs of four records, which are merged in two levels
+    std::mt19937 generator(7);
+    vector<int> records(10000);
+    for (auto &record : records)
+    {
+        record = static_cast<int>(generator() % 1000);
+    }
+    ExternalSorter<int> sorter(4 * sizeof(int));
+    for (const int record : records)
+    {
+        sorter.add(record);
+    }
+    vector<int> merged;
+    sorter.merge([&merged](int record) {merged.push_back(record);});
+    REQUIRE (sorter.run_count() == records.size() / 4);
+    std::sort(records.begin(), records.end());
+    REQUIRE (merged == records);
+
+    // Files whose beginnings are the same, and the same up to the last byte.
+    // A limit that holds a few candidates finds what the unlimited engines
+    // find.
+    const fs::path test_dir_path = create_test_dir();
+    create_size_groups(test_dir_path, 40, 6);
+    for (const auto &bytes : {"0", "16"})
+    {
+        const vector<string> arguments = {"dedup", "--compare-memory", "0",
+            "-b", bytes, test_dir_path.string()};
+        const auto expected = sorted_names(find_duplicates<uint64_t>(
+            parse_cl_args(arguments)));
+        REQUIRE (expected.size() >= 120);
+        for (const auto &limit : {"1", "100", "100000"})
+        {
+            auto limited = arguments;
+            limited.insert(limited.end(), {"--external-memory", limit});
+            REQUIRE (sorted_names(find_duplicates<uint8_t>(
+                parse_cl_args(limited))) == expected);
+            REQUIRE (sorted_names(find_duplicates<Digest128>(
+                parse_cl_args(limited))) == expected);
+            auto threaded = limited;
+            threaded.insert(threaded.end(), {"--hash-threads", "3"});
+            REQUIRE (sorted_names(find_duplicates<uint16_t>(
+                parse_cl_args(threaded))) == expected);
+            limited.insert(limited.end(), {"-a", "16", "--trust-hash"});
+            REQUIRE (sorted_names(find_duplicates<Digest128>(
+                parse_cl_args(limited))) == expected);
+        }
+    }
+
+    // The engine doesn't silently replace the one that was chosen
+    for (const auto &engine : {"-n", "-t", "-v"})
+    {
+        REQUIRE_THROWS_AS (parse_cl_args({"dedup", engine,
+            "--external-memory", "100", test_dir_path.string()}),
+            EndException);
+    }
+}
+
+TEST_CASE( "test_allocations" )
+{
+    // A table in an arena with room for it allocates nothing
+    vector<char> buffer(1 << 17);
+    std::pmr::monotonic_buffer_resource arena(buffer.data(), buffer.size());
+    const size_t before_table = allocation_count();
+    {
+        GroupTable<uint64_t> table(1000, &arena);
+        for (FileId id = 0; id < 1000; ++id)
+        {
+            table.insert(id / 2, id);
+        }
+        REQUIRE (table.for_each_group([](const FileId *, size_t) {}) == 0);
+    }
+    REQUIRE (allocation_count() == before_table);
+
+    // Once the buffers have grown to the largest group, each engine only
+    // allocates the sets that it finds, and a few times as its containers
+    // grow. Each size group has four files, which are two pairs of
+    // identical files, so the groups are split and compared.
+    const fs::path test_dir_path = create_test_dir();
+    const auto allocations = [&test_dir_path](int file_count,
+                                              const string &engine)
+    {
+        fs::remove_all(test_dir_path);
+        fs::create_directories(test_dir_path);
+        for (int i = 0; i < file_count; ++i)
+        {
+            std::ofstream outfile (test_dir_path / 
+                ("allocation_test_file_" + std::to_string(i)));
+            outfile << string(64 + i / 4, 'x') << std::setw(8) << i / 2;
+            outfile.close();
+        }
+        vector<string> arguments = {"dedup", "--compare-memory", "0", "-b",
+            "0", test_dir_path.string()};
+        if (engine != "")
+        {
+            arguments.push_back(engine);
+        }
+        const ArgMap cl_args = parse_cl_args(arguments);
+        const size_t before = allocation_count();
+        const auto duplicates = find_duplicates<uint64_t>(cl_args);
+        const size_t count = allocation_count() - before;
+        REQUIRE (duplicates.sets.size() == size_t(file_count / 2));
+        return count - duplicates.sets.size();
+    };
+    for (const string engine : 
+         {"", "-t", "-v", "-n", "--external-memory=100000"})
+    {
+        const size_t small = allocations(1000, engine);
+        const size_t large = allocations(2000, engine);
+        REQUIRE (large - small <= 16);
+    }
+}